@@ -0,0 +1,259 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+#include "ChessConstants.h"
+#include "KoggeStone.h"
+#include "State.h"
+#include "Search.h"
+#include "Uci.h"
+
+/*
+	Micro benchmarks for the building blocks of the move generator
+	Positions are taken from the STS suite, parsing them is not part of the measured time.
+*/
+
+struct SliderBenchEntry {
+	U64 rook_sliders;
+	U64 bishop_sliders;
+	U64 occupancy;
+};
+
+struct SliderLookupBackend {
+	SliderBackend backend;
+	U64(DataTable::* get_rook_move)(U64, U64);
+	U64(DataTable::* get_bishop_move)(U64, U64);
+};
+
+const std::array<SliderLookupBackend, 3> SLIDER_LOOKUP_BACKENDS = { {
+	{ SliderBackend::Pext, &DataTable::get_rook_move_pext, &DataTable::get_bishop_move_pext },
+	{ SliderBackend::Magic, &DataTable::get_rook_move_magic, &DataTable::get_bishop_move_magic },
+	{ SliderBackend::Classical, &DataTable::get_rook_move_classical, &DataTable::get_bishop_move_classical },
+} };
+
+class Slider_bench {
+public:
+	DataTable& data_table = DataTable::getInstance();
+	std::vector<SliderBenchEntry> entries;
+	std::vector<std::string> missing_files;
+
+	void load_entries() {
+		StateWhite stw = StateWhite();
+		StateBlack stb = StateBlack();
+		for (U8 sts_index = 1; sts_index <= 15; sts_index++) {
+			std::string file_name = "STS/STS" + std::to_string(sts_index) + ".cpd";
+			std::ifstream input(file_name);
+			if (!input.is_open()) { missing_files.push_back(file_name); continue; }
+
+			for (std::string line; getline(input, line);) {
+				std::string fen = splitString(line, ',')[0];
+				State* st = &stw;
+				if (splitString(fen, ' ')[1] == "b") st = &stb;
+				st->loadFenString(fen);
+
+				for (U8 side = 0; side < 2; side++) {
+					U64 queens = st->piecesBB[WHITE_QUEENS_ID + side];
+					entries.push_back({ st->piecesBB[WHITE_ROOKS_ID + side] | queens, st->piecesBB[WHITE_BISHOPS_ID + side] | queens, st->piecesBB[ALL_PIECES_ID] });
+				}
+			}
+		}
+	}
+
+	U64 table_coverage(SliderBenchEntry& entry) {
+		U64 coverage = 0ULL;
+		for (U64 rooks = entry.rook_sliders; rooks != 0; rooks &= rooks - 1) coverage |= data_table.get_rook_move(bsf(rooks), entry.occupancy);
+		for (U64 bishops = entry.bishop_sliders; bishops != 0; bishops &= bishops - 1) coverage |= data_table.get_bishop_move(bsf(bishops), entry.occupancy);
+		return coverage;
+	}
+
+	U64 kogge_stone(SliderBenchEntry& entry) { return kogge_stone_coverage(entry.rook_sliders, entry.bishop_sliders, entry.occupancy); }
+
+	U64 lookup_coverage(SliderBenchEntry& entry, const SliderLookupBackend& lookup) {
+		U64 coverage = 0ULL;
+		for (U64 rooks = entry.rook_sliders; rooks != 0; rooks &= rooks - 1) coverage |= (data_table.*lookup.get_rook_move)(bsf(rooks), entry.occupancy);
+		for (U64 bishops = entry.bishop_sliders; bishops != 0; bishops &= bishops - 1) coverage |= (data_table.*lookup.get_bishop_move)(bsf(bishops), entry.occupancy);
+		return coverage;
+	}
+
+	// Bytes of lookup data the backend reads, everything beyond L2 shows up as cache misses during move generation
+	U64 table_bytes(SliderBackend backend) {
+		if (backend == SliderBackend::Pext) return sizeof(data_table.rook_pext_moves) + sizeof(data_table.bishop_pext_moves) + 4 * sizeof(BoardArray);
+		else if (backend == SliderBackend::Magic) return sizeof(data_table.rook_magic_moves) + sizeof(data_table.bishop_magic_moves) + 2 * sizeof(BoardArray);
+		return sizeof(data_table.slider_rays);
+	}
+
+	double time_lookup_backend(U32 iterations, U64& checksum, const SliderLookupBackend& lookup) {
+		auto start = std::chrono::high_resolution_clock::now();
+		for (U32 i = 0; i < iterations; i++) {
+			for (auto& entry : entries) checksum += lookup_coverage(entry, lookup);
+		}
+		U64 time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+		return time_taken / ((double)iterations * entries.size());
+	}
+
+	std::string lookup_results_str(U32 iterations) {
+		std::stringstream out;
+		out << std::fixed << std::setprecision(2) << "Slider lookups per side:";
+
+		U64 mismatches = 0;
+		for (auto& lookup : SLIDER_LOOKUP_BACKENDS) {
+			if (lookup.backend == SliderBackend::Pext && !cpu_has_bmi2()) continue;
+			for (auto& entry : entries) mismatches += lookup_coverage(entry, lookup) != lookup_coverage(entry, SLIDER_LOOKUP_BACKENDS[2]);
+
+			U64 checksum = 0ULL;
+			out << " " << slider_backend_name(lookup.backend) << ": " << time_lookup_backend(iterations, checksum, lookup) << " ns (" << (table_bytes(lookup.backend) >> 10) << " kB) |";
+		}
+		out << " Mismatches: " << mismatches << "\n"
+			<< "Detected backend: " << slider_backend_name(detect_slider_backend()) << " | Backend in use: " << slider_backend_name(data_table.slider_backend) << "\n";
+		return out.str();
+	}
+
+	// Returns nanoseconds per position, the checksum keeps the compiler from removing the work
+	double time_backend(U32 iterations, U64& checksum, U64(Slider_bench::* coverage_func)(SliderBenchEntry&)) {
+		auto start = std::chrono::high_resolution_clock::now();
+		for (U32 i = 0; i < iterations; i++) {
+			for (auto& entry : entries) checksum += (this->*coverage_func)(entry);
+		}
+		U64 time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+		return time_taken / ((double)iterations * entries.size());
+	}
+
+	std::string run(U32 iterations) {
+		load_entries();
+
+		std::stringstream out;
+		for (auto& file_name : missing_files) out << "Failed to open " << file_name << "\n";
+		if (entries.empty()) return out.str() + "No slider bench positions loaded, run it from the directory containing STS/";
+
+		U64 mismatches = 0;
+		for (auto& entry : entries) mismatches += table_coverage(entry) != kogge_stone(entry);
+
+		U64 table_checksum = 0ULL, kogge_stone_checksum = 0ULL;
+		double table_time = time_backend(iterations, table_checksum, &Slider_bench::table_coverage);
+		double kogge_stone_time = time_backend(iterations, kogge_stone_checksum, &Slider_bench::kogge_stone);
+
+		out << std::fixed << std::setprecision(2)
+			<< "Slider coverage over " << entries.size() << " sides, " << iterations << " iterations\n"
+			<< lookup_results_str(iterations)
+			<< slider_backend_name(data_table.slider_backend) << ": " << table_time << " ns | Kogge-Stone: " << kogge_stone_time << " ns | Speedup: " << table_time / kogge_stone_time << "x\n"
+			<< "Mismatches: " << mismatches << ((table_checksum == kogge_stone_checksum) ? "" : " | Checksums differ");
+		return out.str();
+	}
+};
+
+void UCI::process_slider_bench(std::vector<std::string> split_msg) {
+	U32 iterations = (split_msg.size() > 1) ? (U32)std::stoi(split_msg[1]) : 100;
+	Slider_bench bench = Slider_bench();
+	uci_resp(bench.run(iterations));
+}
+
+/*
+	Search benchmark
+	Searches a fixed set of positions to a fixed depth. With a single thread the node total only depends
+	on the code, so it doubles as a signature for functional changes between builds. With more threads the
+	positions are split over the threads, which share the transposition table and the total is no longer fixed.
+*/
+
+constexpr std::array<const char*, 18> BENCH_POSITIONS = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+	"4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - -",
+	"rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - -",
+	"r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - -",
+	"r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - -",
+	"r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq -",
+	"r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - -",
+	"4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - -",
+	"2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ -",
+	"r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - -",
+	"3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - -",
+	"r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - -",
+	"4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - -",
+	"3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - -",
+	"6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - -",
+	"8/8/8/8/5kp1/P7/8/1K1N4 w - -",
+};
+
+struct BenchResult {
+	Move best_move;
+	U64 nodes = 0;
+};
+
+class Search_bench {
+public:
+	U8 depth;
+	U16 thread_num;
+
+	std::vector<BenchResult> results = std::vector<BenchResult>(BENCH_POSITIONS.size());
+	std::atomic<U64> next_position = 0;
+
+	Search_bench(U8 depth, U16 thread_num) : depth(std::max(depth, (U8)2)), thread_num(std::max(thread_num, (U16)1)) {}
+
+	// Node counting is only compiled into the debug search
+	void bench_worker() {
+		auto search = std::make_unique<Search<Debug>>();
+		auto stw = std::make_unique<StateWhite>();
+		auto stb = std::make_unique<StateBlack>();
+
+		for (U64 i = next_position++; i < BENCH_POSITIONS.size(); i = next_position++) {
+			std::string fen = BENCH_POSITIONS[i];
+			StateMix stx = StateMix(stw.get());
+			if (splitString(fen, ' ')[1] == "b") {
+				stb->loadFenString(fen);
+				stx = StateMix(stb.get());
+			}
+			else stw->loadFenString(fen);
+
+			results[i].best_move = search->depth_search(stx, depth);
+			results[i].nodes = search->stats.total_nodes + search->stats.total_qnodes;
+		}
+	}
+
+	std::string run() {
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> threads;
+		for (U16 i = 0; i < thread_num; i++) threads.emplace_back(&Search_bench::bench_worker, this);
+		for (auto& t : threads) t.join();
+		U64 time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+		std::stringstream out;
+		U64 total_nodes = 0;
+		for (U64 i = 0; i < results.size(); i++) {
+			total_nodes += results[i].nodes;
+			out << "Position " << i + 1 << "/" << results.size() << " | Nodes: " << results[i].nodes << " | Best move: " << results[i].best_move.toUciString() << "\n";
+		}
+		out << "\n"
+			<< "Total time (ms) : " << time_taken / 1000000 << "\n"
+			<< "Nodes searched  : " << total_nodes << "\n"
+			<< "Nodes/second    : " << (U64)(total_nodes / (time_taken / 1e9));
+		return out.str();
+	}
+};
+
+void UCI::process_bench(std::vector<std::string> split_msg) {
+	if (perft_running) { uci_resp("Perft still running, ignoring 'bench'"); return; }
+	U8 depth = (split_msg.size() > 1) ? (U8)std::stoi(split_msg[1]) : 7;
+	U16 thread_num = (split_msg.size() > 2) ? (U16)std::stoi(split_msg[2]) : 1;
+
+	// The signature needs the same hash size and empty tables on every run, the previous size is restored afterwards
+	U64 previous_table_size = dtable.TP_TABLE_SIZE;
+	if (split_msg.size() > 3) dtable.set_hash_table_size((U64)std::stoi(split_msg[3]));
+	else dtable.set_hash_table_size(16);
+	dtable.generate_pawn_hash_table();
+
+	Search_bench bench = Search_bench(depth, thread_num);
+	uci_resp(bench.run());
+
+	dtable.TP_TABLE_SIZE = previous_table_size;
+	dtable.TP_TABLE_SIZE_ROOT = previous_table_size - 1;
+	dtable.generate_search_hash_table(previous_table_size);
+}
@@ -6,33 +6,36 @@
 
 #include "ChessConstants.h"
 
+#ifdef _WIN32
 #include <io.h>
 #include <fcntl.h>
+#endif
 
 #include <iostream>
 #include <fstream>
 #include <map>
 #include <ctype.h>
 
+template<MoveGenPolicy P>
 constexpr U64 (State::*board_move_functions[18])(U64, U64, U8, U8) = {
 	&State::moveNull,
 	&State::moveNull,
 	&State::moveWhitePawnsDouble,
 	&State::moveBlackPawnsDouble,
-	&State::moveWhitePawnsEnpassent,
-	&State::moveBlackPawnsEnpassent,
+	&State::moveWhitePawnsEnpassent<P>,
+	&State::moveBlackPawnsEnpassent<P>,
 	&State::moveNull,
 	&State::moveNull,
-	&State::moveWhitePawnsPromo,
-	&State::moveBlackPawnsPromo,
+	&State::moveWhitePawnsPromo<P>,
+	&State::moveBlackPawnsPromo<P>,
 	&State::moveNull,
 	&State::moveNull,
 	&State::moveNull,
 	&State::moveNull,
 	&State::moveNull,
 	&State::moveNull,
-	&State::moveWhiteKingCastle,
-	&State::moveBlackKingCastle,
+	&State::moveWhiteKingCastle<P>,
+	&State::moveBlackKingCastle<P>,
 };
 
 U8 State::pawn_implicit_promo_check(Move& mv) {
@@ -86,44 +89,71 @@ void State::derivePiecesBB() {
 }
 
 void State::full_eval() {
-	this->mg_eval.base_eval = 0;
-	this->eg_eval.base_eval = 0;
+	this->packed_eval.base_eval = 0;
 	this->total_material = 0;
+	this->material_key = 0ULL;
+	this->packed_eval.extra_eval = 0;
+	this->mobility_evaluated = false;
 	for (U8 i = 0; i < 64; i++) {
 		U8 pieceType = squareOcc[i];
-		this->mg_eval.base_eval += this->data_table->eval.get_pos_eval(pieceType, i) + piece_eval[pieceType];
-		this->eg_eval.base_eval += this->data_table->eval.get_pos_eval_eg(pieceType, i) + piece_eval_eg[pieceType];
+		this->packed_eval.base_eval += this->data_table->eval.get_pos_eval(pieceType, i);
 		this->total_material += piece_score_phases[pieceType];
+		this->material_key += this->data_table->get_material_key(pieceType);
 	}
-	if (this->turn) {
-		this->mg_eval.base_eval *= -1;
-		this->eg_eval.base_eval *= -1;
+	if (this->turn) this->packed_eval.base_eval *= -1;
+	if (this->data_table->use_nnue) refresh_accumulator();
+}
+
+void State::refresh_accumulator() {
+	this->data_table->nnue->refresh(this->nnue_acc, this->squareOcc);
+}
+
+// Called after the board is updated, so a promoted piece is already on the target square
+void State::update_move_nnue(U8 fromIndex, U8 toIndex, U8 fromPieceID, U8 toPieceID, U8 move_index) {
+	const NNUENetwork& network = *this->data_table->nnue;
+	network.move_feature(this->nnue_acc, fromPieceID, fromIndex, this->squareOcc[toIndex], toIndex);
+	if (toPieceID != EMPTY_ID) network.sub_feature(this->nnue_acc, toPieceID, toIndex);
+
+	if (move_index & 0b00100) { // En passant, the captured pawn is behind the target square
+		U8 enpassent_index = (fromPieceID == WHITE_PAWNS_ID) ? toIndex - 8 : toIndex + 8;
+		network.sub_feature(this->nnue_acc, fromPieceID ^ 1, enpassent_index);
+	}
+	else if (move_index & 0b10000) { // Castling, the rook moves as well
+		U8 rookID = WHITE_ROOKS_ID + (fromPieceID & 1);
+		U8 right_castle = (toIndex & 7) == 6;
+		U8 from_rook_index = (toIndex & 56) + (right_castle * 7);
+		U8 to_rook_index = (toIndex & 56) + 3 + (right_castle << 1);
+		network.move_feature(this->nnue_acc, rookID, from_rook_index, rookID, to_rook_index);
 	}
 }
 
 void State::update_move_eval(U8 fromIndex, U8 toIndex, U8 fromPieceID, U8 toPieceID, I16 castle_score) {
-	this->mg_eval.base_eval += this->data_table->eval.get_double_pos_eval(fromPieceID, fromIndex, toIndex) - this->data_table->eval.get_pos_eval(toPieceID, toIndex) - piece_eval[toPieceID];
-	this->eg_eval.base_eval += this->data_table->eval.get_double_pos_eval_eg(fromPieceID, fromIndex, toIndex) - this->data_table->eval.get_pos_eval_eg(toPieceID, toIndex) - piece_eval_eg[toPieceID];
-
-	this->mg_eval.extra_eval += castle_score;
-	this->eg_eval.extra_eval += castle_score;
+	this->packed_eval.base_eval += this->data_table->eval.get_double_pos_eval(fromPieceID, fromIndex, toIndex) - this->data_table->eval.get_pos_eval(toPieceID, toIndex);
+	this->packed_eval.extra_eval += make_score(castle_score, castle_score);
 
 	this->total_material -= piece_score_phases[toPieceID];
+	this->material_key -= this->data_table->get_material_key(toPieceID);
 }
 
-I16 State::get_pawn_structure_eval() {
+PTableEntry& State::get_pawn_entry() {
+	PTableEntry& pEntry = this->data_table->get_ptable_entry(this->pawn_zhash);
+	if (!pEntry.softEquals(this->pawn_zhash)) eval_pawn_structure(pEntry);
+	return pEntry;
+}
+
+void State::eval_pawn_structure(PTableEntry& pEntry) {
 	U64 wpawns = this->piecesBB[WHITE_PAWNS_ID];
 	U64 bpawns = this->piecesBB[BLACK_PAWNS_ID];
 
-	U64 wpawn_attacks = (((wpawns << 7) & NOT_FILE_H) | ((wpawns << 9) & NOT_FILE_A)) << 8;
-	U64 bpawn_attacks = (((bpawns >> 9) & NOT_FILE_H) | ((bpawns >> 7) & NOT_FILE_A)) >> 8;
+	U64 wpawn_attacks = ((wpawns << 7) & NOT_FILE_H) | ((wpawns << 9) & NOT_FILE_A);
+	U64 bpawn_attacks = ((bpawns >> 9) & NOT_FILE_H) | ((bpawns >> 7) & NOT_FILE_A);
 
-	auto process_pawn_structure = [&](U64 friendly_pawnsBB, U64 enemy_pawnsBB, U64 attacks, std::array<PawnStructure, 64>& pawn_structure_arr) {
+	auto process_pawn_structure = [&](U64 friendly_pawnsBB, U64 enemy_pawnsBB, U64 attacks, const std::array<PawnStructure, 64>& pawn_structure_arr) {
 		U64 pawns_copy = friendly_pawnsBB;
 		I16 score = 0;
 		while (pawns_copy != 0) {
 			U8 pIndex = bsf(pawns_copy);
-			PawnStructure& pStruct = pawn_structure_arr[pIndex];
+			const PawnStructure& pStruct = pawn_structure_arr[pIndex];
 
 			if (friendly_pawnsBB & pStruct.partial_file) { // Doubled pawn
 				U8 adjecented_enemy_pawns = (U8)popcnt(enemy_pawnsBB & pStruct.adjecent_forward_files);
@@ -131,7 +161,9 @@ I16 State::get_pawn_structure_eval() {
 				else if (adjecented_enemy_pawns == 1) score -= 10;
 				else score -= 15;
 			}
-			else if ((enemy_pawnsBB & (pStruct.partial_file | pStruct.adjecent_forward_files)) == 0) score += 10; // Passed pawn
+			else if ((enemy_pawnsBB & (pStruct.partial_file | pStruct.adjecent_forward_files)) == 0) { // Passed pawn
+				score += 10;
+			}
 			else if ((friendly_pawnsBB & pStruct.adjecent_back_files) == 0) {
 				if ((friendly_pawnsBB & pStruct.adjecent_files) == 0) score -= 3; // Isolated pawn
 				else if (attacks & (1ULL << pIndex)) score -= 2; // Backward pawn
@@ -141,20 +173,155 @@ I16 State::get_pawn_structure_eval() {
 		return score;
 	};
 
-	I16 wpawn_score = process_pawn_structure(wpawns, bpawns, bpawn_attacks, this->data_table->wpawn_structure);
-	I16 bpawn_score = process_pawn_structure(bpawns, wpawns, wpawn_attacks, this->data_table->bpawn_structure);
-	return wpawn_score - bpawn_score;
+	// Pawns whose stop square is attacked, shifted back onto the pawns
+	I16 wpawn_score = process_pawn_structure(wpawns, bpawns, bpawn_attacks >> 8, this->data_table->wpawn_structure);
+	I16 bpawn_score = process_pawn_structure(bpawns, wpawns, wpawn_attacks << 8, this->data_table->bpawn_structure);
+
+	pEntry.setHash(this->pawn_zhash);
+	pEntry.score = wpawn_score - bpawn_score;
+	for (U8 file = 0; file < 8; file++) {
+		pEntry.king_shelter[WHITE][file] = (I8)wking_shelter(this->data_table->wking_pawns[file], wpawns, bpawns);
+		pEntry.king_shelter[BLACK][file] = (I8)bking_shelter(this->data_table->bking_pawns[56 + file], wpawns, bpawns);
+	}
 }
 
 
 // Tapered eval, uses a weighted average between the middlegame and endgame score. Same trick as MadChess and Fruit to use bitshifts instead of divide
-I16 State::get_eval() {
-	I32 material_score = std::min(total_material, (U16)256);
-	I32 mg_score = (this->mg_eval.base_eval + this->mg_eval.extra_eval) * material_score;
-	I32 eg_score = (this->eg_eval.base_eval + this->eg_eval.extra_eval) * (256 - material_score);
+I16 State::get_tapered_eval(I32 phase) {
+	Score score = this->packed_eval.base_eval + this->packed_eval.extra_eval;
+	I32 mg_score = mg_value(score) * phase;
+	I32 eg_score = eg_value(score) * (256 - phase);
 	return (I16)((mg_score + eg_score) >> 8);
 }
 
+// Runs the lazy mobility stage once, the covered squares of the position must be known
+I16 State::get_eval() {
+	if (!this->mobility_evaluated && !this->data_table->use_nnue) eval_mobility();
+	return get_board_eval();
+}
+
+// Evaluation without the lazy stage, also valid right after a move before the moves of the position are generated
+// Endings go through the material table, a bare king is checked separately since KXK can still have a lot of material
+I16 State::get_board_eval() {
+	if (this->data_table->use_nnue) return this->data_table->nnue->evaluate(this->nnue_acc, this->turn);
+
+	bool bare_king = (this->piecesBB[WHITE_PIECES_ID] == this->piecesBB[WHITE_KING_ID]) | (this->piecesBB[BLACK_PIECES_ID] == this->piecesBB[BLACK_KING_ID]);
+	if (total_material <= ENDGAME_MATERIAL || bare_king) return eval_endgame();
+	return get_tapered_eval(std::min(total_material, (U16)256));
+}
+
+/*
+	Material table
+*/
+
+MTableEntry& State::get_material_entry() {
+	MTableEntry& mEntry = this->data_table->get_mtable_entry(this->material_key);
+	if (!mEntry.softEquals(this->material_key)) eval_material(mEntry);
+	return mEntry;
+}
+
+void State::eval_material(MTableEntry& mEntry) {
+	std::array<U8, 12> counts;
+	for (U8 i = 0; i < 12; i++) counts[i] = (U8)popcnt(this->piecesBB[i]);
+
+	auto pawns = [&](U8 color) { return counts[WHITE_PAWNS_ID + color]; };
+	auto knights = [&](U8 color) { return counts[WHITE_KNIGHTS_ID + color]; };
+	auto bishops = [&](U8 color) { return counts[WHITE_BISHOPS_ID + color]; };
+	auto majors = [&](U8 color) { return counts[WHITE_ROOKS_ID + color] + counts[WHITE_QUEENS_ID + color]; };
+
+	mEntry.key = this->material_key;
+	mEntry.phase = std::min(total_material, (U16)256);
+	mEntry.endgame = EG_NONE;
+	mEntry.strong_side = WHITE;
+
+	for (U8 color = 0; color < 2; color++) {
+		U8 enemy = color ^ 1;
+
+		// Without pawns a single minor piece or two knights cannot force a win, mates are still possible when the other side helps
+		bool no_mating_material = pawns(color) == 0 && majors(color) == 0 && (knights(color) + bishops(color) <= 1 || (bishops(color) == 0 && knights(color) <= 2));
+		mEntry.scale[color] = no_mating_material ? 0 : 64;
+
+		bool enemy_bare_king = pawns(enemy) == 0 && knights(enemy) == 0 && bishops(enemy) == 0 && majors(enemy) == 0;
+		if (enemy_bare_king && !no_mating_material && (majors(color) > 0 || bishops(color) >= 2 || (bishops(color) >= 1 && knights(color) >= 1))) {
+			bool kbnk = majors(color) == 0 && pawns(color) == 0 && knights(color) == 1 && bishops(color) == 1;
+			mEntry.endgame = kbnk ? EG_KBNK : EG_KXK;
+			mEntry.strong_side = color;
+		}
+	}
+
+	// Neither side can mate with at most one minor piece on the board
+	bool dead = pawns(WHITE) + pawns(BLACK) + majors(WHITE) + majors(BLACK) == 0 && knights(WHITE) + knights(BLACK) + bishops(WHITE) + bishops(BLACK) <= 1;
+	if (dead) mEntry.endgame = EG_DRAW;
+	else if (mEntry.endgame == EG_NONE && bishops(WHITE) == 1 && bishops(BLACK) == 1 && knights(WHITE) + knights(BLACK) + majors(WHITE) + majors(BLACK) == 0)
+		mEntry.endgame = EG_BISHOPS;
+}
+
+// Dead positions where no sequence of moves mates: KvK, KNvK, KBvK and bishops only, all on squares of one color
+bool State::is_material_draw() {
+	if (total_material > ENDGAME_MATERIAL) return false;
+	U64 knights = this->piecesBB[WHITE_KNIGHTS_ID] | this->piecesBB[BLACK_KNIGHTS_ID];
+	U64 bishops = this->piecesBB[WHITE_BISHOPS_ID] | this->piecesBB[BLACK_BISHOPS_ID];
+	U64 kings = this->piecesBB[WHITE_KING_ID] | this->piecesBB[BLACK_KING_ID];
+	if (this->piecesBB[ALL_PIECES_ID] & ~(kings | knights | bishops)) return false;
+
+	if (knights) return bishops == 0 && popcnt(knights) == 1;
+	return (bishops & DARK_SQUARES) == 0 || (bishops & ~DARK_SQUARES) == 0;
+}
+
+/*
+	Endgame evaluators
+	Scores are from the perspective of the side to move, the mop-up evaluators score for the strong side and
+	add a bonus above any regular evaluation, so the search converts into them and then drives the weak king into a corner.
+*/
+
+constexpr I16 KNOWN_WIN_SCORE = 2000;
+
+constexpr U8 king_distance(U8 square_a, U8 square_b) {
+	return std::max(abs((square_a & 7) - (square_b & 7)), abs((square_a >> 3) - (square_b >> 3)));
+}
+
+// Files and ranks away from the four center squares, 0 in the center and 6 in a corner
+constexpr U8 center_distance(U8 square) {
+	U8 file = square & 7, rank = square >> 3;
+	return std::max(3 - file, file - 4) + std::max(3 - rank, rank - 4);
+}
+
+I16 State::eval_endgame() {
+	MTableEntry& mEntry = get_material_entry();
+	I16 eval = get_tapered_eval(mEntry.phase);
+
+	if (mEntry.endgame == EG_DRAW) return 0;
+	else if (mEntry.endgame == EG_KXK || mEntry.endgame == EG_KBNK) {
+		I16 strong_eval = (mEntry.strong_side == this->turn) ? eval : -eval;
+		I16 score = strong_eval + ((mEntry.endgame == EG_KXK) ? eval_kxk(mEntry.strong_side) : eval_kbnk(mEntry.strong_side));
+		return (mEntry.strong_side == this->turn) ? score : -score;
+	}
+
+	U8 scale = mEntry.scale[(eval > 0) ? this->turn : this->turn ^ 1];
+	if (mEntry.endgame == EG_BISHOPS) {
+		U64 bishops = this->piecesBB[WHITE_BISHOPS_ID] | this->piecesBB[BLACK_BISHOPS_ID];
+		bool opposite_colors = popcnt(bishops & DARK_SQUARES) == 1;
+		if (opposite_colors) scale /= 2;
+	}
+	return (I16)((I32)eval * scale / 64);
+}
+
+// Bare king against mating material: the weak king is pushed to the edge and the strong king follows it
+I16 State::eval_kxk(U8 strong_side) {
+	U8 strong_king = bsf(this->piecesBB[WHITE_KING_ID + strong_side]);
+	U8 weak_king = bsf(this->piecesBB[WHITE_KING_ID + (strong_side ^ 1)]);
+	return KNOWN_WIN_SCORE + center_distance(weak_king) * 20 + (7 - king_distance(strong_king, weak_king)) * 10;
+}
+
+// Bishop and knight: the weak king can only be mated in a corner of the bishop's color
+I16 State::eval_kbnk(U8 strong_side) {
+	U8 strong_king = bsf(this->piecesBB[WHITE_KING_ID + strong_side]);
+	U8 weak_king = bsf(this->piecesBB[WHITE_KING_ID + (strong_side ^ 1)]);
+	bool dark_bishop = this->piecesBB[WHITE_BISHOPS_ID + strong_side] & DARK_SQUARES;
+	U8 corner_distance = dark_bishop ? std::min(king_distance(weak_king, 0), king_distance(weak_king, 63)) : std::min(king_distance(weak_king, 7), king_distance(weak_king, 56));
+	return KNOWN_WIN_SCORE + (7 - corner_distance) * 40 + center_distance(weak_king) * 10 + (7 - king_distance(strong_king, weak_king)) * 10;
+}
+
 void State::recalc_zobrist() {
 	this->zobrist_hash = 0ULL;
 	this->pawn_zhash = 0ULL;
@@ -185,6 +352,10 @@ void State::printUnicodeBoardStringSimple() {
 }
 
 void State::printUnicodeBoardString() {
+#ifndef _WIN32
+	// Wide output would switch the orientation of stdout and break all later narrow output
+	printUnicodeBoardStringSimple();
+#else
 	_setmode(_fileno(stdout), _O_U16TEXT);
 
 	const wchar_t* piecesUnicode[13] = { L"♙", L"♟︎", L"♘", L"♞", L"♗", L"♝", L"♖", L"♜", L"♔", L"♚", L"♕", L"♛",  L"." };
@@ -199,6 +370,7 @@ void State::printUnicodeBoardString() {
 	std::wcout << std::endl;
 
 	_setmode(_fileno(stdout), _O_TEXT);
+#endif
 }
 
 void State::loadFenString(std::string fen) {
@@ -234,6 +406,7 @@ void State::loadFenString(std::string fen) {
 	}
 	for (int i = 0; i < 9; i++)	std::reverse(this->squareOcc.begin() + (i - 1) * 8, this->squareOcc.begin() + i * 8);
 	this->derivePiecesBB();
+	this->refresh_slider_attacks();
 
 	this->turn = fen_split[1] == "b";
 
@@ -320,6 +493,7 @@ void State::construct_startpos(DataTable* mtable) {
 	this->move_iter = move_arr;
 
 	deriveSquareOcc();
+	refresh_slider_attacks();
 	update_moves(0ULL);
 	recalc_zobrist();
 	full_eval();
@@ -350,6 +524,7 @@ void State::internal_move_inplace(Move& mv) {
 
 	U8 fromPieceID = this->squareOcc[fromIndex];
 	U8 toPieceID = this->squareOcc[toIndex];
+	U64 old_occupancy = this->piecesBB[ALL_PIECES_ID];
 
 	this->squareOcc[fromIndex] = EMPTY_ID;
 	this->squareOcc[toIndex] = fromPieceID;
@@ -379,7 +554,8 @@ void State::internal_move_inplace(Move& mv) {
 	U64 old_enp = enpassent_square;
 
 	if (move_index <= 1) this->movePiece(fromPieceBB, toPieceBB);
-	else (this->*board_move_functions[move_index])(fromPieceBB, toPieceBB, promoID, toIndex);
+	else (this->*board_move_functions<FULL_GEN>[move_index])(fromPieceBB, toPieceBB, promoID, toIndex);
+	if constexpr (INCREMENTAL_SLIDER_ATTACKS) this->update_slider_attacks(old_occupancy ^ this->piecesBB[ALL_PIECES_ID], toPieceBB);
 
 	this->zobrist_hash ^= this->data_table->get_zobrist_hash(fromIndex, fromPieceID)
 		^ this->data_table->get_zobrist_hash(toIndex, fromPieceID)
@@ -432,6 +608,7 @@ U64 State::moveBlackPawnsDouble(U64 fromPieceBB, U64 toPieceBB, U8, U8) {
 	return 0ULL;
 }
 
+template<MoveGenPolicy P>
 U64 State::moveWhitePawnsEnpassent(U64 fromPieceBB, U64 toPieceBB, U8, U8 toIndex) {
 	U64 enpassent_pawn = toPieceBB >> 8;
 	U8 enpassent_index = toIndex - 8;
@@ -448,14 +625,19 @@ U64 State::moveWhitePawnsEnpassent(U64 fromPieceBB, U64 toPieceBB, U8, U8 toInde
 	this->piecesBB[ALL_PIECES_ID] = ~empty_pieces;
 	this->enpassent_square = 0ULL;
 
-	this->pawn_zhash ^= this->data_table->get_zhash_bpawn_table(enpassent_index);
-	this->zobrist_hash ^= this->data_table->get_zobrist_hash(enpassent_index, BLACK_PAWNS_ID);
-	this->mg_eval.base_eval -= this->data_table->eval.get_pos_eval(BLACK_PAWNS_ID, toIndex) + piece_eval[BLACK_PAWNS_ID];
-	this->eg_eval.base_eval -= this->data_table->eval.get_pos_eval_eg(BLACK_PAWNS_ID, toIndex) + piece_eval_eg[BLACK_PAWNS_ID];
+	if constexpr (GEN_HASH) {
+		this->pawn_zhash ^= this->data_table->get_zhash_bpawn_table(enpassent_index);
+		this->zobrist_hash ^= this->data_table->get_zobrist_hash(enpassent_index, BLACK_PAWNS_ID);
+	}
+	if constexpr (GEN_EVAL) {
+		this->packed_eval.base_eval -= this->data_table->eval.get_pos_eval(BLACK_PAWNS_ID, toIndex);
+		this->material_key -= this->data_table->get_material_key(BLACK_PAWNS_ID);
+	}
 
 	return this->data_table->queen_lines[enpassent_index].queen;
 }
 
+template<MoveGenPolicy P>
 U64 State::moveBlackPawnsEnpassent(U64 fromPieceBB, U64 toPieceBB, U8, U8 toIndex) {
 	U64 enpassent_pawn = toPieceBB << 8;
 	U8 enpassent_index = toIndex + 8;
@@ -472,14 +654,19 @@ U64 State::moveBlackPawnsEnpassent(U64 fromPieceBB, U64 toPieceBB, U8, U8 toInde
 	this->piecesBB[ALL_PIECES_ID] = ~empty_pieces;
 	this->enpassent_square = 0ULL;
 
-	this->pawn_zhash ^= this->data_table->get_zhash_wpawn_table(enpassent_index);
-	this->zobrist_hash ^= this->data_table->get_zobrist_hash(enpassent_index, WHITE_PAWNS_ID);
-	this->mg_eval.base_eval -= this->data_table->eval.get_pos_eval(WHITE_PAWNS_ID, toIndex) + piece_eval[WHITE_PAWNS_ID];
-	this->eg_eval.base_eval -= this->data_table->eval.get_pos_eval_eg(WHITE_PAWNS_ID, toIndex) + piece_eval_eg[WHITE_PAWNS_ID];
+	if constexpr (GEN_HASH) {
+		this->pawn_zhash ^= this->data_table->get_zhash_wpawn_table(enpassent_index);
+		this->zobrist_hash ^= this->data_table->get_zobrist_hash(enpassent_index, WHITE_PAWNS_ID);
+	}
+	if constexpr (GEN_EVAL) {
+		this->packed_eval.base_eval -= this->data_table->eval.get_pos_eval(WHITE_PAWNS_ID, toIndex);
+		this->material_key -= this->data_table->get_material_key(WHITE_PAWNS_ID);
+	}
 
 	return this->data_table->queen_lines[enpassent_index].queen;
 }
 
+template<MoveGenPolicy P>
 U64 State::moveWhitePawnsPromo(U64 fromPieceBB, U64 toPieceBB, U8 promoID, U8 toIndex) {
 	U64 empty_squares = this->piecesBB[EMPTY_ID] | fromPieceBB;
 	this->piecesBB[WHITE_PIECES_ID] ^= fromPieceBB | toPieceBB;
@@ -492,15 +679,20 @@ U64 State::moveWhitePawnsPromo(U64 fromPieceBB, U64 toPieceBB, U8 promoID, U8 to
 	this->piecesBB[promoID] |= toPieceBB;
 	this->squareOcc[toIndex] = promoID;
 
-	this->pawn_zhash ^= this->data_table->get_zhash_wpawn_table(toIndex);
-	this->zobrist_hash ^= this->data_table->get_zobrist_hash(bsf(toPieceBB), WHITE_PAWNS_ID) ^ this->data_table->get_zobrist_hash(toIndex, promoID);
-	this->mg_eval.base_eval += this->data_table->eval.get_pos_eval(promoID, toIndex) + piece_eval[promoID] - piece_eval[WHITE_PAWNS_ID];
-	this->eg_eval.base_eval += this->data_table->eval.get_pos_eval_eg(promoID, toIndex) + piece_eval[promoID] - piece_eval_eg[WHITE_PAWNS_ID];
-	this->total_material += piece_score_phases[promoID];
+	if constexpr (GEN_HASH) {
+		this->pawn_zhash ^= this->data_table->get_zhash_wpawn_table(toIndex);
+		this->zobrist_hash ^= this->data_table->get_zobrist_hash(bsf(toPieceBB), WHITE_PAWNS_ID) ^ this->data_table->get_zobrist_hash(toIndex, promoID);
+	}
+	if constexpr (GEN_EVAL) {
+		this->packed_eval.base_eval += this->data_table->eval.get_pos_eval(promoID, toIndex) - this->data_table->eval.get_pos_eval(WHITE_PAWNS_ID, toIndex);
+		this->total_material += piece_score_phases[promoID];
+		this->material_key += this->data_table->get_material_key(promoID) - this->data_table->get_material_key(WHITE_PAWNS_ID);
+	}
 
 	return 0ULL;
 }
 
+template<MoveGenPolicy P>
 U64 State::moveBlackPawnsPromo(U64 fromPieceBB, U64 toPieceBB, U8 promoID, U8 toIndex) {
 	U64 empty_squares = this->piecesBB[EMPTY_ID] | fromPieceBB;
 	this->piecesBB[WHITE_PIECES_ID] &= ~toPieceBB;
@@ -513,15 +705,20 @@ U64 State::moveBlackPawnsPromo(U64 fromPieceBB, U64 toPieceBB, U8 promoID, U8 to
 	this->piecesBB[promoID] |= toPieceBB;
 	this->squareOcc[toIndex] = promoID;
 
-	this->pawn_zhash ^= this->data_table->get_zhash_bpawn_table(toIndex);
-	this->zobrist_hash ^= this->data_table->get_zobrist_hash(bsf(toPieceBB), BLACK_PAWNS_ID) ^ this->data_table->get_zobrist_hash(toIndex, promoID);
-	this->mg_eval.base_eval += this->data_table->eval.get_pos_eval(promoID, toIndex) + piece_eval[promoID] - piece_eval[BLACK_PAWNS_ID];
-	this->eg_eval.base_eval += this->data_table->eval.get_pos_eval_eg(promoID, toIndex) + piece_eval[promoID] - piece_eval_eg[BLACK_PAWNS_ID];
-	this->total_material += piece_score_phases[promoID];
+	if constexpr (GEN_HASH) {
+		this->pawn_zhash ^= this->data_table->get_zhash_bpawn_table(toIndex);
+		this->zobrist_hash ^= this->data_table->get_zobrist_hash(bsf(toPieceBB), BLACK_PAWNS_ID) ^ this->data_table->get_zobrist_hash(toIndex, promoID);
+	}
+	if constexpr (GEN_EVAL) {
+		this->packed_eval.base_eval += this->data_table->eval.get_pos_eval(promoID, toIndex) - this->data_table->eval.get_pos_eval(BLACK_PAWNS_ID, toIndex);
+		this->total_material += piece_score_phases[promoID];
+		this->material_key += this->data_table->get_material_key(promoID) - this->data_table->get_material_key(BLACK_PAWNS_ID);
+	}
 
 	return 0ULL;
 }
 
+template<MoveGenPolicy P>
 U64 State::moveWhiteKingCastle(U64 fromPieceBB, U64 toPieceBB, U8, U8 toIndex) {
 	U8 right_castle = toIndex == 6;
 	U8 from_rook_index = 0 + (right_castle * 7);
@@ -541,13 +738,15 @@ U64 State::moveWhiteKingCastle(U64 fromPieceBB, U64 toPieceBB, U8, U8 toIndex) {
 	this->piecesBB[ALL_PIECES_ID] = ~empty_squares;
 	this->enpassent_square = 0ULL;
 
-	this->zobrist_hash ^= this->data_table->get_zobrist_hash(from_rook_index, WHITE_ROOKS_ID) ^ this->data_table->get_zobrist_hash(to_rook_index, WHITE_ROOKS_ID);
-	this->mg_eval.base_eval += this->data_table->eval.get_double_pos_eval(WHITE_ROOKS_ID, from_rook_index, to_rook_index);
-	this->eg_eval.base_eval += this->data_table->eval.get_double_pos_eval_eg(WHITE_ROOKS_ID, from_rook_index, to_rook_index);
+	if constexpr (GEN_HASH) this->zobrist_hash ^= this->data_table->get_zobrist_hash(from_rook_index, WHITE_ROOKS_ID) ^ this->data_table->get_zobrist_hash(to_rook_index, WHITE_ROOKS_ID);
+	if constexpr (GEN_EVAL) {
+		this->packed_eval.base_eval += this->data_table->eval.get_double_pos_eval(WHITE_ROOKS_ID, from_rook_index, to_rook_index);
+	}
 
 	return this->data_table->queen_lines[from_rook_index].queen | this->data_table->queen_lines[to_rook_index].queen;
 }
 
+template<MoveGenPolicy P>
 U64 State::moveBlackKingCastle(U64 fromPieceBB, U64 toPieceBB, U8, U8 toIndex) {
 	U8 right_castle = toIndex == 62;
 	U8 from_rook_index = 56 + (right_castle * 7);
@@ -567,10 +766,26 @@ U64 State::moveBlackKingCastle(U64 fromPieceBB, U64 toPieceBB, U8, U8 toIndex) {
 	this->piecesBB[ALL_PIECES_ID] = ~empty_squares;
 	this->enpassent_square = 0ULL;
 
-	this->zobrist_hash ^= this->data_table->get_zobrist_hash(from_rook_index, BLACK_ROOKS_ID) ^ this->data_table->get_zobrist_hash(to_rook_index, BLACK_ROOKS_ID);
-	this->mg_eval.base_eval += this->data_table->eval.get_double_pos_eval(BLACK_ROOKS_ID, from_rook_index, to_rook_index);
-	this->eg_eval.base_eval += this->data_table->eval.get_double_pos_eval_eg(BLACK_ROOKS_ID, from_rook_index, to_rook_index);
+	if constexpr (GEN_HASH) this->zobrist_hash ^= this->data_table->get_zobrist_hash(from_rook_index, BLACK_ROOKS_ID) ^ this->data_table->get_zobrist_hash(to_rook_index, BLACK_ROOKS_ID);
+	if constexpr (GEN_EVAL) {
+		this->packed_eval.base_eval += this->data_table->eval.get_double_pos_eval(BLACK_ROOKS_ID, from_rook_index, to_rook_index);
+	}
 
 	return this->data_table->queen_lines[from_rook_index].queen | this->data_table->queen_lines[to_rook_index].queen;
 }
 
+/*
+	Explicit instantiations of the special board moves for every move generator policy
+*/
+
+#define INSTANTIATE_BOARD_MOVES(P) \
+	template U64 State::moveWhitePawnsEnpassent<P>(U64, U64, U8, U8); \
+	template U64 State::moveBlackPawnsEnpassent<P>(U64, U64, U8, U8); \
+	template U64 State::moveWhitePawnsPromo<P>(U64, U64, U8, U8); \
+	template U64 State::moveBlackPawnsPromo<P>(U64, U64, U8, U8); \
+	template U64 State::moveWhiteKingCastle<P>(U64, U64, U8, U8); \
+	template U64 State::moveBlackKingCastle<P>(U64, U64, U8, U8);
+
+INSTANTIATE_BOARD_MOVES(FULL_GEN)
+INSTANTIATE_BOARD_MOVES(HASH_GEN)
+INSTANTIATE_BOARD_MOVES(PURE_GEN)
@@ -2,15 +2,24 @@
 
 #include <array>
 #include <string>
+#include <vector>
+#include <bit>
+#include <algorithm>
 #include <immintrin.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+
 /*
 	Typedefs
 */
 
 #define str_lower(x) std::transform(x.begin(), x.end(), x.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
 
-#define vmirror _byteswap_uint64
 #define popcnt _mm_popcnt_u64
 #define bsf (U8)std::countr_zero
 #define bsr std::countl_zero
@@ -29,6 +38,59 @@ typedef int8_t I8;
 
 typedef std::array<U64, 64> BoardArray;
 
+/*
+	Portability layer
+	MSVC and GCC/Clang name their byte swap and CPUID intrinsics differently
+*/
+
+#ifdef _MSC_VER
+#define vmirror _byteswap_uint64
+#else
+#define vmirror __builtin_bswap64
+#endif
+
+constexpr U64 rotl64(U64 bb, int shift) { return std::rotl(bb, shift); }
+
+// The PEXT lookups are compiled for BMI2 even when the build targets older CPUs, they are only called once CPUID reports it
+#ifdef _MSC_VER
+#define TARGET_BMI2
+#else
+#define TARGET_BMI2 __attribute__((target("bmi2")))
+#endif
+
+inline void cpuid(int cpu_info[4], int leaf, int subleaf = 0) {
+#ifdef _MSC_VER
+	__cpuidex(cpu_info, leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, cpu_info[0], cpu_info[1], cpu_info[2], cpu_info[3]);
+#endif
+}
+
+// Portable PEXT, PDEP and byte swap, the lookup tables are built with these so they can be generated at compile time and on CPUs without BMI2
+constexpr U64 pext_portable(U64 src, U64 mask) {
+	U64 result = 0ULL;
+	for (U64 bit = 1ULL; mask != 0; bit <<= 1) {
+		if (src & mask & (~mask + 1)) result |= bit;
+		mask &= mask - 1;
+	}
+	return result;
+}
+
+constexpr U64 pdep_portable(U64 src, U64 mask) {
+	U64 result = 0ULL;
+	for (U64 bit = 1ULL; mask != 0; bit <<= 1) {
+		if (src & bit) result |= mask & (~mask + 1);
+		mask &= mask - 1;
+	}
+	return result;
+}
+
+constexpr U64 vmirror_portable(U64 bb) {
+	U64 result = 0ULL;
+	for (int i = 0; i < 8; i++) result |= ((bb >> (i * 8)) & 0xFF) << ((7 - i) * 8);
+	return result;
+}
+
 /*
 	Bitboard accessors
 */
@@ -96,6 +158,14 @@ struct Move {
 		return indexToString(from()) + indexToString(to()) + promotionType(promotion());
 	}
 
+	// UCI notation has no trailing blank for moves without a promotion and lowercase promotions for both sides
+	std::string toUciString() {
+		std::string mv_str = toString();
+		if (mv_str.back() == ' ') mv_str.pop_back();
+		else mv_str.back() = (char)std::tolower(mv_str.back());
+		return mv_str;
+	}
+
 	constexpr U8 promotion_from_string(std::string mv, U8 turn) {
 		if (mv.size() == 4 || mv[4] == ' ') return 0;
 		constexpr U8 promoID[6] = { WHITE_BISHOPS_ID, WHITE_QUEENS_ID, WHITE_ROOKS_ID, 0, 0, WHITE_KNIGHTS_ID };
@@ -146,6 +216,8 @@ constexpr U64 FILE_H = 0x8080808080808080;
 constexpr std::array<U64, 8> RANKS = { RANK_1, RANK_2, RANK_3, RANK_4, RANK_5, RANK_6, RANK_7, RANK_8 };
 constexpr std::array<U64, 8> FILES = { FILE_A, FILE_B, FILE_C, FILE_D, FILE_E, FILE_F, FILE_G, FILE_H };
 
+constexpr U64 DARK_SQUARES = 0xAA55AA55AA55AA55;
+
 /*
 	Diagonals and Anti-Diagonals
 */
@@ -2,12 +2,15 @@
 
 #include <iostream>
 #include <array>
+#include <bit>
+#include <tuple>
+#include <algorithm>
 
 #include "ChessConstants.h"
 
 /*
 	King, Knight and Pawn Move Generation
-	Generates squareIndex look up tables
+	Generates squareIndex look up tables at compile time
 
 	These are jumping pieces, which do not need complicated sliding attack logic. 
 	Hence they can be mapped to a simple table with 64 squares denoting each pseudo-legal move.
@@ -23,13 +26,47 @@ constexpr U64 KNIGHT_ATTACKS_LD = 0x142200221400;
 constexpr U64 KING_ATTACKS_LD = 0x1c141c0000;
 constexpr U64 PAWN_ATTACKS_LD = 0x1400000000;
 
-void generate_all_jump_moves(BoardArray* all_moves_p, U64 attacks);
-
-void generate_all_knight_moves(BoardArray* all_moves_p);
-
-void generate_all_king_moves(BoardArray* all_moves_p);
-
-void generate_all_pawn_attacks(BoardArray* all_moves_white_p, BoardArray* all_moves_black_p);
+constexpr BoardArray generate_all_jump_moves(U64 attacks) {
+	BoardArray all_moves = {};
+
+	// Quadrant starting pieces
+	U64 start_piece_LU = 0x800000000, start_piece_RU = 0x1000000000;
+	U64 start_piece_LD = 0x8000000, start_piece_RD = 0x10000000;
+
+	U64 attacks_LU = attacks << 8, attacks_RU = attacks << 9;
+	U64 attacks_LD = attacks << 0, attacks_RD = attacks << 1;
+
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			all_moves[bsf(start_piece_LD >> (i * 8 + j))] = (attacks_LD >> (i * 8 + j)) & notHG78;
+			all_moves[bsf(start_piece_LU >> j << (i * 8))] = (attacks_LU >> j << (i * 8)) & notHG12;
+			all_moves[bsf(start_piece_RD << j >> (i * 8))] = (attacks_RD << j >> (i * 8)) & notAB78;
+			all_moves[bsf(start_piece_RU << (i * 8 + j))] = (attacks_RU << (i * 8 + j)) & notAB12;
+		}
+	}
+	return all_moves;
+}
+
+constexpr BoardArray generate_all_knight_moves() {
+	return generate_all_jump_moves(KNIGHT_ATTACKS_LD);
+}
+
+constexpr BoardArray generate_all_king_moves() {
+	return generate_all_jump_moves(KING_ATTACKS_LD);
+}
+
+constexpr BoardArray generate_all_pawn_attacks(int color) {
+	BoardArray white_attacks = generate_all_jump_moves(PAWN_ATTACKS_LD);
+	if (color == WHITE) return white_attacks;
+
+	BoardArray black_attacks = {};
+	for (int i = 0; i < 8; i++) {
+		for (int j = 0; j < 8; j++) {
+			black_attacks[63 - (i * 8 + (7 - j))] = vmirror_portable(white_attacks[i * 8 + j]);
+		}
+	}
+	return black_attacks;
+}
 
 /*
 	Rook Move Generation
@@ -37,21 +74,48 @@ void generate_all_pawn_attacks(BoardArray* all_moves_white_p, BoardArray* all_mo
 
 	Uses o^(o-2r) to generate moves for both positive and negative rays through
 	the use of fast mirroring bitwise actions.
+	The blocking masks and square offsets are known at compile time, the attack tables
+	themselves are too large for constexpr evaluation and are filled in at startup.
 */
 
 constexpr U64 ROOK_TABLE_SIZE = 102400;
 
+constexpr U64 generate_rook_blocking_mask(U64 pieceIndex) {
+	U64 rankMask = RANKS[pieceIndex >> 3] & ~(FILE_A | FILE_H);
+	U64 fileMask = FILES[pieceIndex & 7] & ~(RANK_1 | RANK_8);
+	return (rankMask | fileMask) & ~(1ULL << pieceIndex);
+}
+
+constexpr BoardArray generate_rook_blocking_masks() {
+	BoardArray blocking_masks = {};
+	for (U64 pieceIndex = 0; pieceIndex < 64; pieceIndex++) blocking_masks[pieceIndex] = generate_rook_blocking_mask(pieceIndex);
+	return blocking_masks;
+}
+
+// Every square owns 2^(blocking squares) consecutive entries in the table
+constexpr BoardArray generate_square_offsets(const BoardArray& blocking_masks) {
+	BoardArray square_offsets = {};
+	U64 total_current_offset = 0;
+	for (U64 pieceIndex = 0; pieceIndex < 64; pieceIndex++) {
+		square_offsets[pieceIndex] = total_current_offset;
+		total_current_offset += 1ULL << std::popcount(blocking_masks[pieceIndex]);
+	}
+	return square_offsets;
+}
+
+constexpr BoardArray ROOK_BLOCKING_MASKS = generate_rook_blocking_masks();
+constexpr BoardArray ROOK_SQUARE_OFFSETS = generate_square_offsets(ROOK_BLOCKING_MASKS);
+static_assert(ROOK_SQUARE_OFFSETS[63] + (1ULL << std::popcount(ROOK_BLOCKING_MASKS[63])) == ROOK_TABLE_SIZE);
+
 U64 hmirror_rank(U64 bb, U64 rankBB);
 
 U64 o_xor_o_2r(U64 block_mask, U64 lineBB, U64 pieceBBx2);
 
-U64 generate_rook_blocking_mask(U64 pieceIndex, U64 rankBB, U64 fileBB, U64 pieceBB);
-
 U64 generate_rook_moves_for_block_mask(U64 block_mask, U64 fileBB, U64 rankBB, U64 pieceBBx2, U64 pieceBBx2_file_mirror, U64 pieceBBx2_rank_mirror);
 
-U64 generate_rook_moves_for_index(std::array<U64, ROOK_TABLE_SIZE>* all_moves_p, BoardArray* blocking_masks, U64 pieceIndex, U64 offset);
+void generate_rook_moves_for_index(std::array<U64, ROOK_TABLE_SIZE>* all_moves_p, U64 pieceIndex);
 
-void generate_all_rook_moves(std::array<U64, ROOK_TABLE_SIZE>* all_moves_p, BoardArray* blocking_masks, BoardArray* square_offsets);
+void generate_all_rook_moves(std::array<U64, ROOK_TABLE_SIZE>* all_moves_p);
 
 /*
 	Bishop Move Generation
@@ -66,16 +130,110 @@ constexpr U64 BISHOP_TABLE_SIZE = 5248;
 
 constexpr U64 notAH18 = ~(FILE_A | FILE_H | RANK_1 | RANK_8);
 
+constexpr U64 generate_bishop_blocking_mask(U64 pieceIndex) {
+	U64 row = pieceIndex >> 3;
+	U64 column = pieceIndex & 7;
+	return (DIAGS[row - column + 7] ^ A_DIAGS[row + column]) & notAH18;
+}
+
+constexpr BoardArray generate_bishop_blocking_masks() {
+	BoardArray blocking_masks = {};
+	for (U64 pieceIndex = 0; pieceIndex < 64; pieceIndex++) blocking_masks[pieceIndex] = generate_bishop_blocking_mask(pieceIndex);
+	return blocking_masks;
+}
+
+constexpr BoardArray BISHOP_BLOCKING_MASKS = generate_bishop_blocking_masks();
+constexpr BoardArray BISHOP_SQUARE_OFFSETS = generate_square_offsets(BISHOP_BLOCKING_MASKS);
+static_assert(BISHOP_SQUARE_OFFSETS[63] + (1ULL << std::popcount(BISHOP_BLOCKING_MASKS[63])) == BISHOP_TABLE_SIZE);
+
 U64 rotate_bishop_to_rook_mask(U64 bishop_mask, U64 diagBB, U64 adiagBB, U64 rankBB, U64 fileBB, U64 diag_index, U64 adiag_index);
 
 U64 rotate_rook_to_bishop_mask(U64 rook_mask, U64 diagBB, U64 adiagBB, U64 rankBB, U64 fileBB, U64 diag_index, U64 adiag_index);
 
-U64 generate_bishop_moves_for_index(std::array<U64, BISHOP_TABLE_SIZE>* all_moves_p, BoardArray* blocking_masks, U64 pieceIndex, U64 offset);
+void generate_bishop_moves_for_index(std::array<U64, BISHOP_TABLE_SIZE>* all_moves_p, U64 pieceIndex);
+
+void generate_all_bishop_moves(std::array<U64, BISHOP_TABLE_SIZE>* all_moves_p);
+
+/*
+	Magic bitboards
+	Fancy magics over the same blocking masks as the PEXT tables, so each square keeps its PEXT table size.
+	Found with a sparse random search, verified to map every blocker subset without destructive collisions.
+*/
+
+constexpr BoardArray ROOK_MAGICS = {
+	0x1080004008801020ULL, 0x840092002c03000ULL, 0x1900200010400900ULL, 0x880100008000480ULL,
+	0x4200100420080200ULL, 0x8100020100080400ULL, 0x200040110886200ULL, 0x200008040220411ULL,
+	0x404800084400220ULL, 0x401000402000ULL, 0x86001081220440ULL, 0x408800800100280ULL,
+	0xa001201040820ULL, 0x8848800200840080ULL, 0x4001000100040200ULL, 0x442000102105084ULL,
+	0x9080010020804100ULL, 0x40404000201009ULL, 0x808010002009ULL, 0x2200090021d00100ULL,
+	0x8008008040080ULL, 0x4004002010040ULL, 0x11040008015042ULL, 0xa0001768104ULL,
+	0x800080204009ULL, 0x2010004140002001ULL, 0x9800200280100080ULL, 0x1000100080080080ULL,
+	0x442000a00049020ULL, 0x2100040080020080ULL, 0x800120400900148ULL, 0x10040a00128541ULL,
+	0x2800804000800030ULL, 0x1010002000400041ULL, 0x4000200011004100ULL, 0x610008410800800ULL,
+	0x400802402800800ULL, 0xc100020080800400ULL, 0x2000802000401ULL, 0x182085882000401ULL,
+	0x220204000808000ULL, 0x2860100040024022ULL, 0x1002004110040ULL, 0x99101042000a0020ULL,
+	0x4080004008080ULL, 0x10040002008080ULL, 0x2012004881020004ULL, 0x8300842444820011ULL,
+	0x88403882010200ULL, 0x820400080210100ULL, 0x110910040a00300ULL, 0x801100280080480ULL,
+	0x242009008200600ULL, 0x1002000489500200ULL, 0x40800200010080ULL, 0x91800041000080ULL,
+	0x209300488001ULL, 0x4c1002414824001ULL, 0x20020000b001041ULL, 0x7000100004200901ULL,
+	0x8002002004100802ULL, 0x30010002084c0007ULL, 0x888221800813004ULL, 0x4000002840840112ULL
+};
+
+constexpr BoardArray BISHOP_MAGICS = {
+	0xa010041108003100ULL, 0x6082020a002900ULL, 0x6810010619200000ULL, 0x8281a0520000408ULL,
+	0x1104001000400ULL, 0x18901008048400ULL, 0x40a0210245280ULL, 0x200210808a402ULL,
+	0x9140048410821200ULL, 0x800091010820041ULL, 0x20504804832202c0ULL, 0x100091401081000ULL,
+	0x8021011140000012ULL, 0x810020804450400ULL, 0x208b0542109008a2ULL, 0x80084a08040204ULL,
+	0x40e2a80811244cULL, 0x2505022008008108ULL, 0x430220100420040ULL, 0x10a040420220040ULL,
+	0x1105000290400000ULL, 0x93001200822120ULL, 0x4000a62048043004ULL, 0x280120048a015004ULL,
+	0x6090002a020814ULL, 0x44042000240800d0ULL, 0x1102800040a4400ULL, 0x1004080080220040ULL,
+	0x1001011004024ULL, 0x10044000805040ULL, 0x914041200820100ULL, 0x4821012821480ULL,
+	0x24040500c05021ULL, 0x88611002080200ULL, 0x116080a00040020ULL, 0x4000020080080080ULL,
+	0x2450450140840040ULL, 0x880201484100ULL, 0x222020404020092ULL, 0x8081110600002e00ULL,
+	0x2842101105000801ULL, 0x1100809008001025ULL, 0x20202221c0400ULL, 0x422014022009020ULL,
+	0x210046102100c00ULL, 0xc004008082029102ULL, 0xaa461801101200ULL, 0x404080080201108ULL,
+	0x20542108c205002ULL, 0x410544804100100ULL, 0x40910841100000ULL, 0x400200042021100ULL,
+	0x4204850400c0ULL, 0x200100410a42102ULL, 0x1040020801210102ULL, 0x805040410420000ULL,
+	0x2884804130100200ULL, 0x800c262201242000ULL, 0x1058000194108800ULL, 0x14221054420204ULL,
+	0x104000012a02200ULL, 0x200881003300100ULL, 0x140400202840100ULL, 0x402020801010201ULL
+};
+
+constexpr std::array<U8, 64> generate_magic_shifts(const BoardArray& blocking_masks) {
+	std::array<U8, 64> magic_shifts = {};
+	for (int i = 0; i < 64; i++) magic_shifts[i] = 64 - (U8)std::popcount(blocking_masks[i]);
+	return magic_shifts;
+}
+
+void generate_all_rook_magic_moves(std::array<U64, ROOK_TABLE_SIZE>* magic_moves_p, const std::array<U64, ROOK_TABLE_SIZE>& pext_moves);
 
-void generate_all_bishop_moves(std::array<U64, BISHOP_TABLE_SIZE>* all_moves_p, BoardArray* blocking_masks, BoardArray* square_offsets);
+void generate_all_bishop_magic_moves(std::array<U64, BISHOP_TABLE_SIZE>* magic_moves_p, const std::array<U64, BISHOP_TABLE_SIZE>& pext_moves);
+
+/*
+	Classical ray attacks
+	Portable fallback, the first blocker on each ray is found with a bit scan.
+	Directions 0-3 (N, E, NE, NW) run towards higher square indices, 4-7 (S, W, SW, SE) towards lower ones.
+*/
+
+constexpr std::array<BoardArray, 8> generate_all_rays() {
+	constexpr int row_steps[8] = { 1, 0, 1, 1, -1, 0, -1, -1 };
+	constexpr int column_steps[8] = { 0, 1, 1, -1, 0, -1, -1, 1 };
+
+	std::array<BoardArray, 8> rays = {};
+	for (U8 direction = 0; direction < 8; direction++) {
+		for (int pieceIndex = 0; pieceIndex < 64; pieceIndex++) {
+			U64 ray = 0ULL;
+			int row = (pieceIndex >> 3) + row_steps[direction];
+			int column = (pieceIndex & 7) + column_steps[direction];
+			for (; row >= 0 && row < 8 && column >= 0 && column < 8; row += row_steps[direction], column += column_steps[direction]) ray |= 1ULL << (row * 8 + column);
+			rays[direction][pieceIndex] = ray;
+		}
+	}
+	return rays;
+}
 
 /*
 	Lines used for move generation during pinning and checks
+	Kept as separate dense arrays, check masks only touch the partial lines and pins only the indices.
 */
 
 struct QueenLine {
@@ -84,13 +242,115 @@ struct QueenLine {
 	U64 bishop;
 };
 
-struct Line {
-	U64 full;
-	U64 partial;
-	U8 line_index;
+// Slider attacks on an empty board
+constexpr std::array<QueenLine, 64> generate_queen_lines(const std::array<BoardArray, 8>& rays) {
+	std::array<QueenLine, 64> queen_lines = {};
+	for (int i = 0; i < 64; i++) {
+		U64 rook = rays[0][i] | rays[1][i] | rays[4][i] | rays[5][i];
+		U64 bishop = rays[2][i] | rays[3][i] | rays[6][i] | rays[7][i];
+		queen_lines[i] = { rook | bishop, rook, bishop };
+	}
+	return queen_lines;
+}
+
+struct LineTable {
+	std::array<U64, 4096> full;
+	std::array<U64, 4096> partial;
+	std::array<U8, 4096> index;
 };
 
-void generate_all_lines(std::array<Line, 4096>&);
+constexpr std::tuple<U8, U8, U8, U8> extract_indices(U8 squareIndex) {
+	U8 row = squareIndex >> 3;
+	U8 column = squareIndex & 7;
+
+	U8 diag_index = row - column + 7;
+	U8 adiag_index = row + column;
+	return std::tuple(row, column, diag_index, adiag_index);
+}
+
+constexpr U64 get_line_mask(U8 row1, U8 row2, U8 column1, U8 column2) {
+	U8 min_row = std::min(row1, row2);
+	U8 min_column = std::min(column1, column2);
+	U8 row_range = std::max(row1, row2) - min_row;
+	U8 column_range = std::max(column1, column2) - min_column;
+	U64 line_mask = 0ULL;
+
+	if (row_range != 0) for (int i = min_row; i <= min_row+row_range; i++) line_mask |= RANKS[i];
+	if (column_range != 0) for (int i = min_column; i <= min_column+column_range; i++) line_mask |= FILES[i];
+	return line_mask;
+}
+
+constexpr LineTable generate_all_lines() {
+	LineTable all_lines = {};
+	for (U8 i = 0; i < 64; i++) {
+		auto [i_row, i_column, i_diag, i_adiag] = extract_indices(i);
+		for (U8 j = 0; j < 64; j++) {
+			auto [j_row, j_column, j_diag, j_adiag] = extract_indices(j);
+
+			bool row_equal = (i_row == j_row);
+			bool column_equal = (i_column == j_column);
+			bool diag_equal = (i_diag == j_diag);
+			bool adiag_equal = (i_adiag == j_adiag);
+
+			U8 lines_index = (row_equal * i_row) + (!row_equal * 8);
+			lines_index += ((column_equal * i_column) + (!column_equal * 8)) * (lines_index == 8);
+			lines_index += ((diag_equal * i_diag) + (!diag_equal * 15)) * (lines_index == 16);
+			lines_index += ((adiag_equal * i_adiag) + (!adiag_equal * 15)) * (lines_index == 31);
+			lines_index++;
+
+			// Squares that share no line fall past the last anti-diagonal, they map to the full board instead
+			if (lines_index == ALL_LINES.size()) lines_index = 0;
+
+			U64 line_mask = get_line_mask(i_row, j_row, i_column, j_column) & ~(1ULL << i);
+			all_lines.full[(i << 6) + j] = ALL_LINES[lines_index];
+			all_lines.partial[(i << 6) + j] = ALL_LINES[lines_index] & line_mask;
+			all_lines.index[(i << 6) + j] = lines_index;
+		}
+	}
+	return all_lines;
+}
+
+/*
+	Compressed PEXT tables
+	Every attack set is a subset of the rays on an empty board, so it is stored PEXT'ed over those rays as 16 bits
+	and expanded again with PDEP on lookup. Shrinks the rook table from 800 kB to 200 kB, which fits in L2.
+*/
+
+void compress_rook_moves(std::array<U16, ROOK_TABLE_SIZE>* compressed_moves_p, const std::array<U64, ROOK_TABLE_SIZE>& pext_moves, const std::array<QueenLine, 64>& queen_lines);
+
+void compress_bishop_moves(std::array<U16, BISHOP_TABLE_SIZE>* compressed_moves_p, const std::array<U64, BISHOP_TABLE_SIZE>& pext_moves, const std::array<QueenLine, 64>& queen_lines);
+
+/*
+	Zobrist keys
+	Drawn from a fixed seed at compile time, so hashes and the hash dependent node counts are identical between runs.
+*/
+
+constexpr U64 ZOBRIST_SEED = 2183994271ULL;
+
+// SplitMix64, advances the state and returns the next key
+constexpr U64 splitmix64(U64& state) {
+	U64 z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+constexpr std::array<U64, 848> generate_zobrist_hashes() {
+	std::array<U64, 848> zhash_table = {};
+	U64 state = ZOBRIST_SEED;
+	for (int i = 0; i < 768; i++) zhash_table[i] = splitmix64(state);
+	for (int i = 832; i < 848; i++) zhash_table[i] = splitmix64(state);
+	return zhash_table;
+}
+
+// Material keys are added per piece instead of xor'ed, so the key only depends on the piece counts
+constexpr std::array<U64, 13> generate_material_keys() {
+	std::array<U64, 13> material_keys = {};
+	U64 state = ZOBRIST_SEED ^ 0x6D617465726961ULL;
+	for (int i = 0; i < 12; i++) material_keys[i] = splitmix64(state);
+	material_keys[WHITE_KING_ID] = material_keys[BLACK_KING_ID] = 0ULL; // Both kings are always on the board
+	return material_keys;
+}
 
 /*
 	Misc
@@ -103,6 +363,19 @@ struct KingPawns {
 	U64 pawn_storm;
 };
 
+// Pawns in front of the king and enemy pawns storming it, the second shield rank counts for less
+inline I16 wking_shelter(const KingPawns& wking_pawns, U64 wpawns, U64 bpawns) {
+	I16 eval = (I16)popcnt(wking_pawns.pawn_shield & wpawns) * 8;
+	eval += (I16)popcnt((wking_pawns.pawn_shield << 8) & wpawns) * 6;
+	return eval - (I16)popcnt(wking_pawns.pawn_storm & bpawns) * 8;
+}
+
+inline I16 bking_shelter(const KingPawns& bking_pawns, U64 wpawns, U64 bpawns) {
+	I16 eval = (I16)popcnt(bking_pawns.pawn_shield & bpawns) * 8;
+	eval += (I16)popcnt((bking_pawns.pawn_shield >> 8) & bpawns) * 6;
+	return eval - (I16)popcnt(bking_pawns.pawn_storm & wpawns) * 8;
+}
+
 struct PawnStructure {
 	U64 file;
 	U64 partial_file;
@@ -111,8 +384,48 @@ struct PawnStructure {
 	U64 adjecent_back_files = 0ULL;
 };
 
-void generate_zobrist_hashes(std::array<U64, 848>& zhash_table);
-
-void generate_king_pawns(std::array<KingPawns, 64>&, std::array<KingPawns, 64>&);
-
-void generate_pawn_structure(std::array<PawnStructure, 64>&, std::array<PawnStructure, 64>&, std::array<Line, 4096>&);
+constexpr std::array<KingPawns, 64> generate_king_pawns(int color) {
+	BoardArray pawn_shields = generate_all_jump_moves(PAWN_SHIELD_LD);
+
+	std::array<KingPawns, 64> king_pawns = {};
+	for (U8 i = 0; i < 64; i++) {
+		U64 pawn_shield = pawn_shields[i];
+		U64 pawn_storm = (pawn_shield << 8) | (pawn_shield << 16);
+		if (color == WHITE) king_pawns[i] = { pawn_shield, pawn_storm };
+		else king_pawns[i] = { vmirror_portable(pawn_shield), vmirror_portable(pawn_storm) };
+	}
+	return king_pawns;
+}
+
+constexpr std::array<PawnStructure, 64> generate_pawn_structure(int color, const LineTable& all_lines) {
+	std::array<PawnStructure, 64> pawn_structure = {};
+	U64 side_ranks_bb = RANK_1 | RANK_8;
+	for (U8 i = 0; i < 64; i++) {
+		U8 file = i & 7;
+		U64 fileBB = FILES[file];
+
+		U8 bottom_index = bsf(side_ranks_bb & fileBB);
+		U8 top_index = 63 - bsr(side_ranks_bb & fileBB);
+
+		U64 upper_line = all_lines.partial[(i << 6) + top_index];
+		U64 bottom_line = all_lines.partial[(i << 6) + bottom_index];
+
+		// Forward for white is towards the 8th rank, for black towards the 1st
+		U64 forward_line = (color == WHITE) ? upper_line : bottom_line;
+		U64 back_line = (color == WHITE) ? bottom_line : upper_line;
+
+		PawnStructure pstruct = { fileBB, forward_line };
+		if (file != 0) {
+			pstruct.adjecent_files |= fileBB >> 1;
+			pstruct.adjecent_forward_files |= forward_line >> 1;
+			pstruct.adjecent_back_files |= back_line >> 1;
+		}
+		if (file != 7) {
+			pstruct.adjecent_files |= fileBB << 1;
+			pstruct.adjecent_forward_files |= forward_line << 1;
+			pstruct.adjecent_back_files |= back_line << 1;
+		}
+		pawn_structure[i] = pstruct;
+	}
+	return pawn_structure;
+}
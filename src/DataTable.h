@@ -1,22 +1,65 @@
 #pragma once
 
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <string>
+
 #include "ChessConstants.h"
 #include "EvalData.h"
+#include "NNUE.h"
 #include "DataGenerator.h"
 
 
-struct HTableEntryPerft {
-	U32 hash = 0ULL;
-	U32 perft_moves = 0ULL;
-	U8 depth = 0U;
+constexpr U8 PERFT_BUCKET_SIZE = 3;
+
+/*
+	Perft table bucket, sized to a single cache line
+	Stores full 64 bit keys and 64 bit node counts. Lockless: the key is stored xor'ed with the count and depth,
+	so a torn write by another perft thread fails the key check on probe. Replacement prefers keeping deeper entries.
+*/
+struct alignas(64) HTableBucketPerft {
+	std::atomic<U64> keys[PERFT_BUCKET_SIZE] = {};
+	std::atomic<U64> perft_moves[PERFT_BUCKET_SIZE] = {};
+	std::atomic<U8> depths[PERFT_BUCKET_SIZE] = {};
+
+	bool probe(U64 zhash, U8 depth, U64& stored_moves) {
+		for (U8 i = 0; i < PERFT_BUCKET_SIZE; i++) {
+			if (depths[i].load(std::memory_order_relaxed) != depth) continue;
+			U64 moves = perft_moves[i].load(std::memory_order_relaxed);
+			if ((keys[i].load(std::memory_order_relaxed) ^ moves ^ depth) != zhash) continue;
+			stored_moves = moves;
+			return true;
+		}
+		return false;
+	}
 
-	bool softEquals(U64 cmp_hash) { return hash == (cmp_hash >> 32); }
-	void setHash(U64 hsh) { this->hash = (hsh >> 32); }
+	void store(U64 zhash, U8 depth, U64 moves) {
+		U8 replace_index = 0;
+		U8 min_depth = 0xFF;
+		for (U8 i = 0; i < PERFT_BUCKET_SIZE; i++) {
+			U8 entry_depth = depths[i].load(std::memory_order_relaxed);
+			if ((keys[i].load(std::memory_order_relaxed) ^ perft_moves[i].load(std::memory_order_relaxed) ^ entry_depth) == zhash) {
+				replace_index = i;
+				break;
+			}
+			if (entry_depth < min_depth) {
+				min_depth = entry_depth;
+				replace_index = i;
+			}
+		}
+		depths[replace_index].store(depth, std::memory_order_relaxed);
+		perft_moves[replace_index].store(moves, std::memory_order_relaxed);
+		keys[replace_index].store(zhash ^ moves ^ depth, std::memory_order_relaxed);
+	}
 };
 
+constexpr I16 EVAL_NONE = INT16_MIN;
+
 struct HTableEntry {
 	U64 hash = 0ULL;
 	I16 score = 0;
+	I16 static_eval = EVAL_NONE; // Stand pat score of the position, fits in the padding of the entry
 	Move best_move = Move(0, 0);
 
 	// Bit packed data, contains node type, depth and bool flag for quiescent entry
@@ -33,35 +76,116 @@ struct HTableEntry {
 	bool is_quiesecent() { return ((node_and_depth >> 5) & 1) == 1; }
 };
 
+static_assert(sizeof(HTableEntry) == 16);
+
+/*
+	Pawn hash entry
+	Holds the pawn structure score and the king shelter of a king on its back rank per king file, two entries share a cache line.
+*/
 struct PTableEntry {
-	U32 hash = 0ULL;
+	U64 hash = ~0ULL; // A board without pawns hashes to 0, so empty entries must not use it
 	I16 score = 0;
+	std::array<I8, 8> king_shelter[2] = {};
 
-	bool softEquals(U64 cmp_hash) { return hash == (cmp_hash >> 32); }
-	void setHash(U64 hsh) { this->hash = (hsh >> 32); }
+	bool softEquals(U64 cmp_hash) { return hash == cmp_hash; }
+	void setHash(U64 hsh) { this->hash = hsh; }
 };
 
-const class DataTable {
+static_assert(sizeof(PTableEntry) == 32);
+
+/*
+	Material table
+	Everything that only depends on the piece counts, computed once per material configuration.
+	Known endings get a specialised evaluator, the others can scale down the endgame score of a side
+	that cannot win with the material it has.
+*/
+enum Endgame : U8 {
+	EG_NONE,
+	EG_DRAW, // At most one minor piece and nothing else, no side can mate
+	EG_KXK, // Bare king against mating material, includes KRK and KQK
+	EG_KBNK,
+	EG_BISHOPS, // One bishop each and pawns, drawish once the bishops are on opposite colors
+};
+
+struct MTableEntry {
+	U64 key = ~0ULL; // Bare kings have the key 0
+	U16 phase = 0;
+	U8 scale[2] = { 64, 64 }; // Endgame score multiplier out of 64, indexed by the side that is ahead
+	U8 endgame = EG_NONE;
+	U8 strong_side = WHITE;
+
+	bool softEquals(U64 cmp_key) { return key == cmp_key; }
+};
+
+static_assert(sizeof(MTableEntry) == 16);
+
+/*
+	Sliding attack backends
+	PEXT is the fastest where the instruction is implemented in hardware, on AMD before Zen 3 it is microcoded
+	and magic bitboards win. The classical ray lookup only needs a bit scan and works everywhere.
+*/
+
+enum class SliderBackend : U8 {
+	Pext,
+	Magic,
+	Classical,
+};
+
+inline std::string slider_backend_name(SliderBackend backend) {
+	if (backend == SliderBackend::Pext) return "PEXT";
+	else if (backend == SliderBackend::Magic) return "Magic";
+	return "Classical";
+}
+
+inline bool cpu_has_bmi2() {
+	int cpu_info[4];
+	cpuid(cpu_info, 0);
+	if (cpu_info[0] < 7) return false;
+	cpuid(cpu_info, 7);
+	return (cpu_info[1] >> 8) & 1;
+}
+
+// Zen 1 and Zen 2 (family 0x17) implement PEXT in microcode
+inline bool cpu_has_slow_pext() {
+	int cpu_info[4];
+	cpuid(cpu_info, 0);
+	bool is_amd = cpu_info[1] == 0x68747541; // "Auth" from "AuthenticAMD"
+
+	cpuid(cpu_info, 1);
+	U32 family = (cpu_info[0] >> 8) & 0xF;
+	if (family == 0xF) family += (cpu_info[0] >> 20) & 0xFF;
+	return is_amd && family < 0x19;
+}
+
+inline SliderBackend detect_slider_backend() {
+	if (!cpu_has_bmi2() || cpu_has_slow_pext()) return SliderBackend::Magic;
+	return SliderBackend::Pext;
+}
+
+class DataTable {
 public:
 	/*
 		Move Generation Data
+		Everything except the slider attack tables is generated at compile time
 	*/
-	BoardArray all_king_moves;
-	BoardArray all_knight_moves;
-	BoardArray all_wpawn_moves;
-	BoardArray all_bpawn_moves;
+	static constexpr BoardArray all_king_moves = generate_all_king_moves();
+	static constexpr BoardArray all_knight_moves = generate_all_knight_moves();
+	static constexpr BoardArray all_wpawn_moves = generate_all_pawn_attacks(WHITE);
+	static constexpr BoardArray all_bpawn_moves = generate_all_pawn_attacks(BLACK);
 
-	BoardArray bishop_square_offsets;
-	BoardArray rook_square_offsets;
+	static constexpr std::array<BoardArray, 8> slider_rays = generate_all_rays();
+	static constexpr std::array<QueenLine, 64> queen_lines = generate_queen_lines(slider_rays);
+	static constexpr LineTable lines = generate_all_lines();
 
-	BoardArray rook_blocking_masks;
-	BoardArray bishop_blocking_masks;
+	// PEXT tables store the attacks compressed over the empty board rays in queen_lines, see compress_rook_moves
+	std::array<U16, ROOK_TABLE_SIZE> rook_pext_moves;
+	std::array<U16, BISHOP_TABLE_SIZE> bishop_pext_moves;
 
-	std::array<U64, ROOK_TABLE_SIZE> all_rook_moves;
-	std::array<U64, BISHOP_TABLE_SIZE> all_bishop_moves;
-
-	std::array<QueenLine, 64> queen_lines;
-	std::array<Line, 4096> line_index;
+	SliderBackend slider_backend = detect_slider_backend();
+	std::array<U64, ROOK_TABLE_SIZE> rook_magic_moves;
+	std::array<U64, BISHOP_TABLE_SIZE> bishop_magic_moves;
+	static constexpr std::array<U8, 64> rook_magic_shifts = generate_magic_shifts(ROOK_BLOCKING_MASKS);
+	static constexpr std::array<U8, 64> bishop_magic_shifts = generate_magic_shifts(BISHOP_BLOCKING_MASKS);
 
 	std::vector<Move> divide_moves = {};
 
@@ -69,42 +193,48 @@ public:
 		Transposition Table Data
 	*/
 
-	std::array<U64, 848> zobrist_hash_table;
+	static constexpr std::array<U64, 848> zobrist_hash_table = generate_zobrist_hashes();
+	static constexpr std::array<U64, 13> material_keys = generate_material_keys();
 
 	HTableEntry* TPT;
-	HTableEntryPerft* TPT_Perft;
 	U64 TP_TABLE_SIZE = 1ULL << 24;
 	U64 TP_TABLE_SIZE_ROOT = (TP_TABLE_SIZE - 1);
 
+	// The size only takes effect at the next perft run, the mask always belongs to the allocated table
+	HTableBucketPerft* TPT_Perft;
+	U64 PERFT_TABLE_SIZE = 1ULL << 20;
+	U64 PERFT_TABLE_SIZE_ROOT = 0;
+
 	/*
 		Evaluation Data
 	*/
 
 	EvalData eval = EvalData();
-	std::array<KingPawns, 64> wking_pawns;
-	std::array<KingPawns, 64> bking_pawns;
+	static constexpr std::array<KingPawns, 64> wking_pawns = generate_king_pawns(WHITE);
+	static constexpr std::array<KingPawns, 64> bking_pawns = generate_king_pawns(BLACK);
 
-	std::array<PawnStructure, 64> wpawn_structure;
-	std::array<PawnStructure, 64> bpawn_structure;
+	static constexpr std::array<PawnStructure, 64> wpawn_structure = generate_pawn_structure(WHITE, lines);
+	static constexpr std::array<PawnStructure, 64> bpawn_structure = generate_pawn_structure(BLACK, lines);
+
+	// Optional NNUE evaluation, only used once a network is loaded and enabled with the UseNNUE option
+	std::unique_ptr<NNUENetwork> nnue;
+	bool use_nnue = false;
 
 	PTableEntry* PHT;
-	U64 PH_TABLE_SIZE = 1ULL << 20; 
+	U64 PH_TABLE_SIZE = 1ULL << 19; // The 8 MB PawnHash default
 	U64 PH_TABLE_SIZE_ROOT = (PH_TABLE_SIZE - 1);
 
+	// Only probed in endings, a few thousand material configurations are more than a search reaches
+	MTableEntry* MT;
+	static constexpr U64 MT_TABLE_SIZE = 1ULL << 12;
+	static constexpr U64 MT_TABLE_SIZE_ROOT = (MT_TABLE_SIZE - 1);
+
 	DataTable() {
 		generate_empty_tables();
-		useSearchTable();
+		generate_search_hash_table(TP_TABLE_SIZE);
 		generate_pawn_hash_table();
-		generate_zobrist_hashes(zobrist_hash_table);
-		generate_all_lines(this->line_index);
-		generate_all_king_moves(&this->all_king_moves);
-		generate_all_knight_moves(&this->all_knight_moves);
-		generate_all_pawn_attacks(&this->all_wpawn_moves, &this->all_bpawn_moves);
-		generate_all_rook_moves(&this->all_rook_moves, &this->rook_blocking_masks, &this->rook_square_offsets);
-		generate_all_bishop_moves(&this->all_bishop_moves, &this->bishop_blocking_masks, &this->bishop_square_offsets);
-		generate_queen_lines();
-		generate_king_pawns(wking_pawns, bking_pawns);
-		generate_pawn_structure(wpawn_structure, bpawn_structure, line_index);
+		MT = new MTableEntry[MT_TABLE_SIZE]();
+		generate_slider_tables();
 	}
 
 	static DataTable& getInstance() {
@@ -123,10 +253,26 @@ public:
 		std::cout << "Number of hash table entries: 2^" << (U16)std::log2(entry_num) << "\n";
 	}
 
+	void set_pawn_table_size(U64 target_MB) {
+		U64 target_bytes = target_MB << 20;
+		U64 entry_num = target_bytes / sizeof(PTableEntry);
+		PH_TABLE_SIZE = 1ULL << (U8)std::log2(entry_num);
+		PH_TABLE_SIZE_ROOT = (PH_TABLE_SIZE - 1);
+		generate_pawn_hash_table();
+		std::cout << "Number of pawn hash table entries: 2^" << (U16)std::log2(entry_num) << "\n";
+	}
+
+	void set_perft_table_size(U64 target_MB) {
+		U64 target_bytes = target_MB << 20;
+		U64 bucket_num = target_bytes / sizeof(HTableBucketPerft);
+		PERFT_TABLE_SIZE = 1ULL << (U8)std::log2(bucket_num);
+		std::cout << "Number of perft table buckets: 2^" << (U16)std::log2(bucket_num) << "\n";
+	}
+
 	void generate_empty_tables() {
 		PHT = new PTableEntry[0];
 		TPT = new HTableEntry[0];
-		TPT_Perft = new HTableEntryPerft[0];
+		TPT_Perft = new HTableBucketPerft[1]();
 	}
 
 	void generate_pawn_hash_table() {
@@ -134,24 +280,20 @@ public:
 		PHT = new PTableEntry[PH_TABLE_SIZE]();
 	}
 
-	void useSearchTable() {
-		generate_perft_hash_table(0);
-		generate_search_hash_table(TP_TABLE_SIZE);
-	}
-
-	void usePerftTable() {
-		generate_search_hash_table(0);
-		generate_perft_hash_table(TP_TABLE_SIZE);
-	}
+	// The perft table is only allocated while perft is running, the search table is left untouched
+	void useSearchTable() { generate_perft_hash_table(1); }
+	void usePerftTable() { generate_perft_hash_table(PERFT_TABLE_SIZE); }
 
 	void generate_search_hash_table(U64 size) {
 		delete[] TPT;
 		TPT = new HTableEntry[size]();
 	}
 
+	// Never called while perft threads probe the table, the dispatcher waits for a running perft
 	void generate_perft_hash_table(U64 size) {
 		delete[] TPT_Perft;
-		TPT_Perft = new HTableEntryPerft[size]();
+		TPT_Perft = new HTableBucketPerft[size]();
+		PERFT_TABLE_SIZE_ROOT = size - 1;
 	}
 
 	constexpr U64 get_zhash_turn() {
@@ -178,14 +320,22 @@ public:
 		return *(TPT + (zhash & TP_TABLE_SIZE_ROOT));
 	}
 
-	constexpr HTableEntryPerft& get_perft_entry(U64 zhash) {
-		return *(TPT_Perft + (zhash & TP_TABLE_SIZE_ROOT));
+	constexpr HTableBucketPerft& get_perft_bucket(U64 zhash) {
+		return *(TPT_Perft + (zhash & PERFT_TABLE_SIZE_ROOT));
 	}
 
 	constexpr PTableEntry& get_ptable_entry(U64 zhash) {
 		return *(PHT + (zhash & PH_TABLE_SIZE_ROOT));
 	}
 
+	constexpr U64 get_material_key(U16 pieceID) {
+		return this->material_keys[pieceID];
+	}
+
+	constexpr MTableEntry& get_mtable_entry(U64 material_key) {
+		return *(MT + (material_key & MT_TABLE_SIZE_ROOT));
+	}
+
 	constexpr U64 get_king_move(U64 squareIndex) {
 		return this->all_king_moves[squareIndex];
 	}
@@ -206,22 +356,72 @@ public:
 		return this->all_bpawn_moves[squareIndex];
 	}
 
-	constexpr void generate_queen_lines() {
-		for (int i = 0; i < 64; i++) {
-			U64 rook = get_rook_move(i, 0ULL);
-			U64 bishop = get_bishop_move(i, 0ULL);
-			this->queen_lines[i] = { rook | bishop, rook, bishop };
-		}
+	// The uncompressed tables are only needed to build the compressed PEXT and the magic tables
+	void generate_slider_tables() {
+		auto all_rook_moves = std::make_unique<std::array<U64, ROOK_TABLE_SIZE>>();
+		auto all_bishop_moves = std::make_unique<std::array<U64, BISHOP_TABLE_SIZE>>();
+		generate_all_rook_moves(all_rook_moves.get());
+		generate_all_bishop_moves(all_bishop_moves.get());
+		compress_rook_moves(&this->rook_pext_moves, *all_rook_moves, this->queen_lines);
+		compress_bishop_moves(&this->bishop_pext_moves, *all_bishop_moves, this->queen_lines);
+		generate_all_rook_magic_moves(&this->rook_magic_moves, *all_rook_moves);
+		generate_all_bishop_magic_moves(&this->bishop_magic_moves, *all_bishop_moves);
 	}
 
 	U64 get_rook_move(U64 squareIndex, U64 occuppationBB) {
-		U64 pext_blocking_mask = pext(occuppationBB, this->rook_blocking_masks[squareIndex]);
-		return this->all_rook_moves[this->rook_square_offsets[squareIndex] + pext_blocking_mask];
+		if (this->slider_backend == SliderBackend::Pext) return get_rook_move_pext(squareIndex, occuppationBB);
+		else if (this->slider_backend == SliderBackend::Magic) return get_rook_move_magic(squareIndex, occuppationBB);
+		return get_rook_move_classical(squareIndex, occuppationBB);
 	}
 
 	U64 get_bishop_move(U64 squareIndex, U64 occuppationBB) {
-		U64 pext_blocking_mask = pext(occuppationBB, this->bishop_blocking_masks[squareIndex]);
-		return this->all_bishop_moves[this->bishop_square_offsets[squareIndex] + pext_blocking_mask];
+		if (this->slider_backend == SliderBackend::Pext) return get_bishop_move_pext(squareIndex, occuppationBB);
+		else if (this->slider_backend == SliderBackend::Magic) return get_bishop_move_magic(squareIndex, occuppationBB);
+		return get_bishop_move_classical(squareIndex, occuppationBB);
+	}
+
+	TARGET_BMI2 U64 get_rook_move_pext(U64 squareIndex, U64 occuppationBB) {
+		U64 pext_blocking_mask = pext(occuppationBB, ROOK_BLOCKING_MASKS[squareIndex]);
+		return pdep(this->rook_pext_moves[ROOK_SQUARE_OFFSETS[squareIndex] + pext_blocking_mask], this->queen_lines[squareIndex].rook);
+	}
+
+	TARGET_BMI2 U64 get_bishop_move_pext(U64 squareIndex, U64 occuppationBB) {
+		U64 pext_blocking_mask = pext(occuppationBB, BISHOP_BLOCKING_MASKS[squareIndex]);
+		return pdep(this->bishop_pext_moves[BISHOP_SQUARE_OFFSETS[squareIndex] + pext_blocking_mask], this->queen_lines[squareIndex].bishop);
+	}
+
+	U64 get_rook_move_magic(U64 squareIndex, U64 occuppationBB) {
+		U64 magic_index = ((occuppationBB & ROOK_BLOCKING_MASKS[squareIndex]) * ROOK_MAGICS[squareIndex]) >> this->rook_magic_shifts[squareIndex];
+		return this->rook_magic_moves[ROOK_SQUARE_OFFSETS[squareIndex] + magic_index];
+	}
+
+	U64 get_bishop_move_magic(U64 squareIndex, U64 occuppationBB) {
+		U64 magic_index = ((occuppationBB & BISHOP_BLOCKING_MASKS[squareIndex]) * BISHOP_MAGICS[squareIndex]) >> this->bishop_magic_shifts[squareIndex];
+		return this->bishop_magic_moves[BISHOP_SQUARE_OFFSETS[squareIndex] + magic_index];
+	}
+
+	U64 get_positive_ray(U8 direction, U64 squareIndex, U64 occuppationBB) {
+		U64 attacks = this->slider_rays[direction][squareIndex];
+		U64 blockers = attacks & occuppationBB;
+		if (blockers) attacks ^= this->slider_rays[direction][bsf(blockers)];
+		return attacks;
+	}
+
+	U64 get_negative_ray(U8 direction, U64 squareIndex, U64 occuppationBB) {
+		U64 attacks = this->slider_rays[direction][squareIndex];
+		U64 blockers = attacks & occuppationBB;
+		if (blockers) attacks ^= this->slider_rays[direction][63 - bsr(blockers)];
+		return attacks;
+	}
+
+	U64 get_rook_move_classical(U64 squareIndex, U64 occuppationBB) {
+		return get_positive_ray(0, squareIndex, occuppationBB) | get_positive_ray(1, squareIndex, occuppationBB)
+			| get_negative_ray(4, squareIndex, occuppationBB) | get_negative_ray(5, squareIndex, occuppationBB);
+	}
+
+	U64 get_bishop_move_classical(U64 squareIndex, U64 occuppationBB) {
+		return get_positive_ray(2, squareIndex, occuppationBB) | get_positive_ray(3, squareIndex, occuppationBB)
+			| get_negative_ray(6, squareIndex, occuppationBB) | get_negative_ray(7, squareIndex, occuppationBB);
 	}
 
 	U64 get_queen_move(U64 squareIndex, U64 occuppationBB) {
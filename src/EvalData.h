@@ -69,6 +69,19 @@ constexpr I16 piece_eval_mult[13] = { 900, 900, 2880, 2880, 2970, 2970, 4500, 45
 constexpr I16 piece_value_linear[12] = { 0, 0, 1, 1, 2, 2, 3, 3, 5, 5, 4, 4 };
 constexpr I16 piece_score_phases[13] = { 0, 0, 10, 10, 10, 10, 22, 22, 0, 0, 44, 44, 0 };
 
+// Positions with at most this much phase material are evaluated through the material table
+constexpr U16 ENDGAME_MATERIAL = 44;
+
+/*
+	Packed score, holds the middlegame score in the lower and the endgame score in the upper 16 bits.
+	Additions, subtractions and negations apply to both halves at once as long as each half fits in an I16.
+*/
+typedef I32 Score;
+
+constexpr Score make_score(I32 mg, I32 eg) { return (Score)((U32)eg << 16) + mg; }
+constexpr I16 mg_value(Score s) { return (I16)(U16)(U32)s; }
+constexpr I16 eg_value(Score s) { return (I16)(U16)((U32)(s + 0x8000) >> 16); }
+
 constexpr std::array<I16, 64> vmirror_psqt(std::array<I16, 64> old_psqt) {
 	std::array<I16, 64> new_psqt;
 	for (U8 i = 0; i < 8; i++)
@@ -247,6 +260,25 @@ constexpr std::array<I16, 64> square_piece_table_eg[13] = {
 	{},
 };
 
+// Combined PSQT and material table
+constexpr std::array<Score, 64> merge_psqt(U8 pieceID) {
+	std::array<Score, 64> psqt;
+	for (U8 i = 0; i < 64; i++) psqt[i] = make_score(square_piece_table[pieceID][i] + piece_eval[pieceID], square_piece_table_eg[pieceID][i] + piece_eval_eg[pieceID]);
+	return psqt;
+}
+
+constexpr std::array<Score, 64> piece_square_scores[13] = {
+	merge_psqt(0), merge_psqt(1), merge_psqt(2), merge_psqt(3), merge_psqt(4), merge_psqt(5), merge_psqt(6),
+	merge_psqt(7), merge_psqt(8), merge_psqt(9), merge_psqt(10), merge_psqt(11), merge_psqt(12),
+};
+
+template<size_t N>
+constexpr std::array<Score, N> merge_mobility(const I8 (&mg)[N], const I8 (&eg)[N]) {
+	std::array<Score, N> scores;
+	for (size_t i = 0; i < N; i++) scores[i] = make_score(mg[i], eg[i]);
+	return scores;
+}
+
 constexpr I8 knight_mobility_scores[9] = { -12, -10, -4, 0, 0, 1, 2, 3, 3 };
 constexpr I8 bishop_mobility_scores[14] = { -10, -5, 1, 3, 4, 5, 5, 6, 6, 7, 8, 8, 9, 9 };
 constexpr I8 rook_mobility_scores[15] = { -12, -5, 0, 0, 0, 1, 2, 3, 4, 4, 4, 4, 5, 5, 6 };
@@ -257,11 +289,26 @@ constexpr I8 bishop_mobility_scores_eg[14] = { -15, -15, 1, 3, 4, 5, 5, 6, 6, 7,
 constexpr I8 rook_mobility_scores_eg[15] = { -18, -10, 0, 0, 0, 1, 2, 3, 4, 4, 4, 4, 5, 5, 6 };
 constexpr I8 queen_mobility_scores_eg[28] = { -20, -15, -6, -3, 2, 2, 2, 3, 4, 5, 6, 7, 7, 7, 7, 7, 7, 7, 7, 8, 9, 10, 10, 10, 11, 11, 11, 12 };
 
+constexpr std::array<Score, 9> knight_mobility = merge_mobility(knight_mobility_scores, knight_mobility_scores_eg);
+constexpr std::array<Score, 14> bishop_mobility = merge_mobility(bishop_mobility_scores, bishop_mobility_scores_eg);
+constexpr std::array<Score, 15> rook_mobility = merge_mobility(rook_mobility_scores, rook_mobility_scores_eg);
+constexpr std::array<Score, 28> queen_mobility = merge_mobility(queen_mobility_scores, queen_mobility_scores_eg);
+
+// Threat terms from the point of view of the side to move, threats against its own pieces weigh less since it can still react
+constexpr Score threat_by_pawn = make_score(40, 32);
+constexpr Score threat_by_minor = make_score(24, 20);
+constexpr Score threat_by_rook = make_score(24, 20);
+constexpr Score hanging_piece = make_score(28, 20);
+constexpr Score threatened_by_pawn = make_score(-20, -16);
+constexpr Score hanging_own_piece = make_score(-14, -10);
+
+// King attack weights per attacking piece and the scale by number of attackers, a single attacker is not counted
+constexpr I16 king_attack_weights[13] = { 0, 0, 2, 2, 2, 2, 3, 3, 0, 0, 5, 5, 0 };
+constexpr I16 king_attack_scale[8] = { 0, 0, 8, 12, 14, 15, 16, 16 };
+constexpr I16 king_zone_pressure = -4;
+
 class EvalData {
 public:
-	constexpr I16 get_pos_eval(U8 pieceID, U8 squareIndex) { return square_piece_table[pieceID][squareIndex]; }
-	constexpr I16 get_double_pos_eval(U8 fromID, U8 fromIndex, U8 toIndex) { return square_piece_table[fromID][toIndex] - square_piece_table[fromID][fromIndex]; }
-
-	constexpr I16 get_pos_eval_eg(U8 pieceID, U8 squareIndex) { return square_piece_table_eg[pieceID][squareIndex]; }
-	constexpr I16 get_double_pos_eval_eg(U8 fromID, U8 fromIndex, U8 toIndex) { return square_piece_table_eg[fromID][toIndex] - square_piece_table_eg[fromID][fromIndex]; }
-};
+	constexpr Score get_pos_eval(U8 pieceID, U8 squareIndex) { return piece_square_scores[pieceID][squareIndex]; }
+	constexpr Score get_double_pos_eval(U8 fromID, U8 fromIndex, U8 toIndex) { return piece_square_scores[fromID][toIndex] - piece_square_scores[fromID][fromIndex]; }
+};
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <immintrin.h>
+
+#include "ChessConstants.h"
+
+/*
+	Kogge-Stone occluded fill for the coverage of all sliders of a side
+	Instead of one PEXT lookup per piece, the rays of every slider are filled at once.
+	Each AVX2 lane handles one direction, the left shifting directions (N, E, NE, NW) share one vector
+	and the right shifting directions (S, W, SW, SE) the other. Rook lanes are seeded with rooks and queens,
+	bishop lanes with bishops and queens. Builds without AVX2 fill the same directions one at a time.
+*/
+
+#ifdef __AVX2__
+inline __m256i kogge_stone_fill_left(__m256i gen, __m256i pro, __m256i shift) {
+	gen = _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_sllv_epi64(gen, shift)));
+	pro = _mm256_and_si256(pro, _mm256_sllv_epi64(pro, shift));
+	shift = _mm256_slli_epi64(shift, 1);
+	gen = _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_sllv_epi64(gen, shift)));
+	pro = _mm256_and_si256(pro, _mm256_sllv_epi64(pro, shift));
+	shift = _mm256_slli_epi64(shift, 1);
+	return _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_sllv_epi64(gen, shift)));
+}
+
+inline __m256i kogge_stone_fill_right(__m256i gen, __m256i pro, __m256i shift) {
+	gen = _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_srlv_epi64(gen, shift)));
+	pro = _mm256_and_si256(pro, _mm256_srlv_epi64(pro, shift));
+	shift = _mm256_slli_epi64(shift, 1);
+	gen = _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_srlv_epi64(gen, shift)));
+	pro = _mm256_and_si256(pro, _mm256_srlv_epi64(pro, shift));
+	shift = _mm256_slli_epi64(shift, 1);
+	return _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_srlv_epi64(gen, shift)));
+}
+
+inline U64 kogge_stone_coverage(U64 rook_sliders, U64 bishop_sliders, U64 occupancy) {
+	const __m256i shift = _mm256_setr_epi64x(8, 1, 9, 7);
+	const __m256i left_wrap = _mm256_setr_epi64x(FULL_BOARD, NOT_FILE_A, NOT_FILE_A, NOT_FILE_H);
+	const __m256i right_wrap = _mm256_setr_epi64x(FULL_BOARD, NOT_FILE_H, NOT_FILE_H, NOT_FILE_A);
+
+	__m256i gen = _mm256_setr_epi64x(rook_sliders, rook_sliders, bishop_sliders, bishop_sliders);
+	__m256i empty = _mm256_set1_epi64x(~occupancy);
+
+	__m256i left = kogge_stone_fill_left(gen, _mm256_and_si256(empty, left_wrap), shift);
+	__m256i right = kogge_stone_fill_right(gen, _mm256_and_si256(empty, right_wrap), shift);
+	left = _mm256_and_si256(_mm256_sllv_epi64(left, shift), left_wrap);
+	right = _mm256_and_si256(_mm256_srlv_epi64(right, shift), right_wrap);
+
+	__m256i attacks = _mm256_or_si256(left, right);
+	__m128i half = _mm_or_si128(_mm256_castsi256_si128(attacks), _mm256_extracti128_si256(attacks, 1));
+	return (U64)(_mm_cvtsi128_si64(half) | _mm_extract_epi64(half, 1));
+}
+#else
+inline U64 kogge_stone_fill_left(U64 gen, U64 pro, U8 shift) {
+	gen |= pro & (gen << shift);
+	pro &= pro << shift;
+	gen |= pro & (gen << (2 * shift));
+	pro &= pro << (2 * shift);
+	return gen | (pro & (gen << (4 * shift)));
+}
+
+inline U64 kogge_stone_fill_right(U64 gen, U64 pro, U8 shift) {
+	gen |= pro & (gen >> shift);
+	pro &= pro >> shift;
+	gen |= pro & (gen >> (2 * shift));
+	pro &= pro >> (2 * shift);
+	return gen | (pro & (gen >> (4 * shift)));
+}
+
+inline U64 kogge_stone_coverage(U64 rook_sliders, U64 bishop_sliders, U64 occupancy) {
+	constexpr U8 shift[4] = { 8, 1, 9, 7 };
+	constexpr U64 left_wrap[4] = { FULL_BOARD, NOT_FILE_A, NOT_FILE_A, NOT_FILE_H };
+	constexpr U64 right_wrap[4] = { FULL_BOARD, NOT_FILE_H, NOT_FILE_H, NOT_FILE_A };
+
+	U64 attacks = 0ULL;
+	for (U8 i = 0; i < 4; i++) {
+		U64 gen = i < 2 ? rook_sliders : bishop_sliders;
+		attacks |= (kogge_stone_fill_left(gen, ~occupancy & left_wrap[i], shift[i]) << shift[i]) & left_wrap[i];
+		attacks |= (kogge_stone_fill_right(gen, ~occupancy & right_wrap[i], shift[i]) >> shift[i]) & right_wrap[i];
+	}
+	return attacks;
+}
+#endif
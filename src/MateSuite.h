@@ -0,0 +1,104 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <memory>
+
+#include "ChessConstants.h"
+#include "State.h"
+#include "Search.h"
+#include "Uci.h"
+
+/*
+	Mate suite
+	Positions with a forced mate, each searched like "go mate N". A position passes once the search proves a mate in
+	at most N moves and its PV, played out on the board, is as long as the mate and ends in checkmate.
+	The node limit only keeps a broken search from running forever, the mates take far fewer nodes.
+	Runs as a ctest test with "Tesseract matesuite".
+*/
+
+constexpr U64 MATE_SUITE_NODE_LIMIT = 50000000;
+
+struct MateSuiteEntry {
+	const char* fen;
+	U8 mate;
+};
+
+constexpr std::array<MateSuiteEntry, 6> MATE_SUITE_POSITIONS = { {
+	{ "6k1/5ppp/8/8/8/8/5PPP/R5K1 w - -", 1 },
+	{ "r5k1/5ppp/8/8/8/8/5PPP/6K1 b - -", 1 },
+	{ "7k/8/8/8/8/8/1R6/R5K1 w - -", 2 },
+	{ "r2qkb1r/pp2nppp/3p4/2pNN1B1/2BnP3/3P4/PPP2PPP/R2bK2R w KQkq -", 2 },
+	{ "8/8/7k/8/8/8/1R6/R5K1 w - -", 3 },
+	{ "2r3k1/p4p2/3Rp2p/1p2P1pK/8/1P4P1/P3Q2P/1q6 b - -", 3 },
+} };
+
+class Mate_suite {
+public:
+	DataTable& data_table = DataTable::getInstance();
+
+	// Empty string when the position passes
+	std::string check_position(MateSuiteEntry entry) {
+		auto search = std::make_unique<Search<Regular>>();
+		auto stw = std::make_unique<StateWhite>();
+		auto stb = std::make_unique<StateBlack>();
+		std::string fen = entry.fen;
+		StateMix stx = StateMix(stw.get());
+		if (splitString(fen, ' ')[1] == "b") {
+			stb->loadFenString(fen);
+			stx = StateMix(stb.get());
+		}
+		else stw->loadFenString(fen);
+
+		SearchLimits limits;
+		limits.mate = entry.mate;
+		limits.nodes = MATE_SUITE_NODE_LIMIT;
+		search->set_limits(limits);
+		data_table.reset_TPT();
+		search->infinite_search(stx);
+
+		if (!search->mate_found()) {
+			std::string found = search->best_moves.empty() ? "nothing" : search->uci_score(search->best_moves.begin()->score());
+			return "Failed " + fen + " | Expected mate in " + std::to_string(entry.mate) + ", found " + found;
+		}
+		std::vector<Move> pv = search->pv_lines.empty() ? std::vector<Move>() : search->pv_lines[0];
+		U64 mate_plies = 2 * mate_in_moves(search->best_moves.begin()->score()) - 1;
+		if (!is_mate_line(stx, pv, mate_plies)) {
+			std::string pv_str;
+			for (Move mv : pv) pv_str += " " + mv.toUciString();
+			return "Failed " + fen + " | PV is not a mate in " + std::to_string(entry.mate) + ":" + pv_str;
+		}
+		return "";
+	}
+
+	bool is_mate_line(StateMix stx, std::vector<Move>& pv, U64 mate_plies) {
+		if (pv.size() != mate_plies) return false;
+		std::vector<AlignedState> aligned_states(pv.size());
+		for (U64 i = 0; i < pv.size(); i++) {
+			State& st = *std::visit(StateCast(), stx);
+			if (std::find(st.move_arr, st.move_iter, pv[i]) == st.move_iter) return false;
+			stx = std::visit(MoveVisitor{ pv[i], &aligned_states[i] }, stx);
+		}
+		State& st = *std::visit(StateCast(), stx);
+		return st.move_iter == st.move_arr && st.in_check;
+	}
+
+	std::string run() {
+		std::stringstream out;
+		U64 failures = 0;
+		for (auto& entry : MATE_SUITE_POSITIONS) {
+			std::string result = check_position(entry);
+			if (result == "") continue;
+			failures++;
+			out << result << "\n";
+		}
+		out << "Mate suite: " << MATE_SUITE_POSITIONS.size() - failures << "/" << MATE_SUITE_POSITIONS.size() << " positions passed";
+		return out.str();
+	}
+};
+
+void UCI::process_mate_suite(std::vector<std::string> split_msg) {
+	Mate_suite suite = Mate_suite();
+	uci_resp(suite.run());
+}
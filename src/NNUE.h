@@ -0,0 +1,170 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <immintrin.h>
+
+#include "ChessConstants.h"
+
+/*
+	NNUE evaluation
+	A (768 -> NNUE_HIDDEN) x 2 -> 1 network with a squared clipped ReLU, in the quantised layout written by bullet
+	(feature weights, feature bias, output weights, output bias, all little endian I16).
+	The inputs are one feature per colour, piece type and square, seen from both sides, so each State keeps
+	one accumulator per perspective that is updated incrementally when a move adds or removes a piece.
+*/
+
+constexpr U16 NNUE_INPUTS = 768;
+constexpr U16 NNUE_HIDDEN = 256;
+constexpr I32 NNUE_QA = 255;
+constexpr I32 NNUE_QB = 64;
+constexpr I32 NNUE_SCALE = 400;
+
+// The network orders the pieces pawn, knight, bishop, rook, queen, king, indexed here by piece ID >> 1
+constexpr U16 nnue_piece_offsets[6] = { 0, 64, 128, 192, 320, 256 };
+
+constexpr U16 nnue_feature(U8 perspective, U8 pieceID, U8 squareIndex) {
+	U16 relative_color = (pieceID & 1) ^ perspective;
+	U16 relative_square = perspective ? (squareIndex ^ 56) : squareIndex;
+	return relative_color * 384 + nnue_piece_offsets[pieceID >> 1] + relative_square;
+}
+
+typedef std::array<I16, NNUE_HIDDEN> NNUEVector;
+
+struct alignas(32) NNUEAccumulator {
+	NNUEVector values[2]; // Indexed by perspective
+};
+
+struct alignas(32) NNUENetwork {
+	NNUEVector feature_weights[NNUE_INPUTS];
+	NNUEVector feature_bias;
+	NNUEVector output_weights[2];
+	I16 output_bias;
+
+	// Files from the trainer are padded, only the weights themselves are read
+	static constexpr U64 file_bytes = sizeof(NNUEVector) * (NNUE_INPUTS + 3) + sizeof(I16);
+
+	void refresh(NNUEAccumulator& acc, const std::array<U8, 64>& squareOcc) const {
+		acc.values[WHITE] = feature_bias;
+		acc.values[BLACK] = feature_bias;
+		for (U8 i = 0; i < 64; i++) {
+			if (squareOcc[i] == EMPTY_ID) continue;
+			add_feature(acc, squareOcc[i], i);
+		}
+	}
+
+	void add_feature(NNUEAccumulator& acc, U8 pieceID, U8 squareIndex) const {
+		for (U8 p = 0; p < 2; p++) {
+			const I16* add = feature_weights[nnue_feature(p, pieceID, squareIndex)].data();
+			I16* values = acc.values[p].data();
+#ifdef __AVX2__
+			for (U16 i = 0; i < NNUE_HIDDEN; i += 16) {
+				__m256i v = _mm256_load_si256((__m256i*)(values + i));
+				v = _mm256_add_epi16(v, _mm256_load_si256((const __m256i*)(add + i)));
+				_mm256_store_si256((__m256i*)(values + i), v);
+			}
+#else
+			for (U16 i = 0; i < NNUE_HIDDEN; i++) values[i] += add[i];
+#endif
+		}
+	}
+
+	void sub_feature(NNUEAccumulator& acc, U8 pieceID, U8 squareIndex) const {
+		for (U8 p = 0; p < 2; p++) {
+			const I16* sub = feature_weights[nnue_feature(p, pieceID, squareIndex)].data();
+			I16* values = acc.values[p].data();
+#ifdef __AVX2__
+			for (U16 i = 0; i < NNUE_HIDDEN; i += 16) {
+				__m256i v = _mm256_load_si256((__m256i*)(values + i));
+				v = _mm256_sub_epi16(v, _mm256_load_si256((const __m256i*)(sub + i)));
+				_mm256_store_si256((__m256i*)(values + i), v);
+			}
+#else
+			for (U16 i = 0; i < NNUE_HIDDEN; i++) values[i] -= sub[i];
+#endif
+		}
+	}
+
+	// A quiet move removes and adds one feature, both are applied in a single pass over the accumulator
+	void move_feature(NNUEAccumulator& acc, U8 fromPieceID, U8 fromIndex, U8 toPieceID, U8 toIndex) const {
+		for (U8 p = 0; p < 2; p++) {
+			const I16* sub = feature_weights[nnue_feature(p, fromPieceID, fromIndex)].data();
+			const I16* add = feature_weights[nnue_feature(p, toPieceID, toIndex)].data();
+			I16* values = acc.values[p].data();
+#ifdef __AVX2__
+			for (U16 i = 0; i < NNUE_HIDDEN; i += 16) {
+				__m256i v = _mm256_load_si256((__m256i*)(values + i));
+				v = _mm256_sub_epi16(v, _mm256_load_si256((const __m256i*)(sub + i)));
+				v = _mm256_add_epi16(v, _mm256_load_si256((const __m256i*)(add + i)));
+				_mm256_store_si256((__m256i*)(values + i), v);
+			}
+#else
+			for (U16 i = 0; i < NNUE_HIDDEN; i++) values[i] += add[i] - sub[i];
+#endif
+		}
+	}
+
+	/*
+		Squared clipped ReLU dot product
+		clamp(x)^2 * w is computed as (clamp(x) * w) * clamp(x) so the first product stays in 16 bits,
+		which holds as long as the trainer clips the output weights to below 128.
+		The scalar version truncates the first product to 16 bits as well, so both give the same evaluation.
+	*/
+#ifdef __AVX2__
+	static __m256i screlu_dot(const NNUEVector& values, const NNUEVector& weights, __m256i sum) {
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i qa = _mm256_set1_epi16(NNUE_QA);
+		for (U16 i = 0; i < NNUE_HIDDEN; i += 16) {
+			__m256i v = _mm256_load_si256((const __m256i*)(values.data() + i));
+			v = _mm256_min_epi16(_mm256_max_epi16(v, zero), qa);
+			__m256i w = _mm256_load_si256((const __m256i*)(weights.data() + i));
+			sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_mullo_epi16(v, w), v));
+		}
+		return sum;
+	}
+#else
+	static I32 screlu_dot(const NNUEVector& values, const NNUEVector& weights) {
+		I32 sum = 0;
+		for (U16 i = 0; i < NNUE_HIDDEN; i++) {
+			I32 v = std::clamp((I32)values[i], 0, NNUE_QA);
+			sum += (I16)(v * weights[i]) * v;
+		}
+		return sum;
+	}
+#endif
+
+	// Score from the perspective of the side to move
+	I16 evaluate(const NNUEAccumulator& acc, U8 turn) const {
+#ifdef __AVX2__
+		__m256i sum256 = _mm256_setzero_si256();
+		sum256 = screlu_dot(acc.values[turn], output_weights[0], sum256);
+		sum256 = screlu_dot(acc.values[turn ^ 1], output_weights[1], sum256);
+
+		__m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum256), _mm256_extracti128_si256(sum256, 1));
+		sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0b01001110));
+		sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0b10110001));
+		I32 sum = _mm_cvtsi128_si32(sum128);
+#else
+		I32 sum = screlu_dot(acc.values[turn], output_weights[0]) + screlu_dot(acc.values[turn ^ 1], output_weights[1]);
+#endif
+
+		I32 output = (sum / NNUE_QA + output_bias) * NNUE_SCALE / (NNUE_QA * NNUE_QB);
+		return (I16)std::clamp(output, -20000, 20000);
+	}
+};
+
+static_assert(offsetof(NNUENetwork, output_bias) + sizeof(I16) == NNUENetwork::file_bytes);
+
+// Returns an empty pointer if the file could not be read or is too small to hold the network
+inline std::unique_ptr<NNUENetwork> load_nnue_network(const std::string& filename) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) return nullptr;
+
+	auto network = std::make_unique<NNUENetwork>();
+	file.read(reinterpret_cast<char*>(network.get()), NNUENetwork::file_bytes);
+	if (file.gcount() != NNUENetwork::file_bytes) return nullptr;
+	return network;
+}
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <memory>
+
+#include "ChessConstants.h"
+#include "State.h"
+#include "Uci.h"
+
+// Perft 13 of the start position is the deepest count that fits the 64 bit node counters
+constexpr U8 PERFT_MAX_DEPTH = 13;
+constexpr U8 PERFT_DEFAULT_DEPTH = 4;
+
+/*
+	Multi-threaded perft
+	Splits the subtrees below the root over a pool of threads. Each thread claims the next
+	unsearched root move, which balances uneven subtrees without any scheduling logic.
+	All threads share the lockless perft table in DataTable.
+*/
+
+template<MoveGenPolicy P>
+struct PerftRootVisitor {
+	Move mv;
+	U8 depth;
+	PerftRootVisitor(Move mv, U8 depth) : mv(mv), depth(depth) {}
+
+	U64 operator()(auto& st) {
+		if (depth <= 1) return 1;
+		U64 total_moves = 0ULL;
+		AlignedState aligned_st;
+		st->template internal_move_aligned<P>(mv, &aligned_st)->template perft_all_moves<P>(depth - 1, total_moves);
+		return total_moves;
+	}
+};
+
+struct PerftThreadStats {
+	U64 nodes = 0;
+	U64 time_taken = 0;
+};
+
+class Perft_runner {
+public:
+	U8 depth;
+	U16 thread_num;
+	bool pure;
+
+	StateWhite stw = StateWhite();
+	StateBlack stb = StateBlack();
+	StateMix root = StateMix(&stw);
+
+	std::vector<Move> root_moves;
+	std::vector<U64> root_nodes;
+	std::vector<PerftThreadStats> thread_stats;
+	std::atomic<U64> next_root_move = 0;
+
+	U64 total_nodes = 0;
+	U64 time_taken = 0;
+
+	Perft_runner(U8 depth, U16 thread_num, bool pure) : depth(std::max(depth, (U8)1)), thread_num(std::max(thread_num, (U16)1)), pure(pure) {}
+
+	void load_root(std::string fen) {
+		if (splitString(fen, ' ')[1] == "b") {
+			stb.loadFenString(fen);
+			root = StateMix(&stb);
+		}
+		else {
+			stw.loadFenString(fen);
+			root = StateMix(&stw);
+		}
+		State& st = *std::visit(StateCast(), root);
+		root_moves = std::vector<Move>(st.move_arr, st.move_iter);
+	}
+
+	template<MoveGenPolicy P>
+	void perft_worker(U16 thread_index) {
+		auto start = std::chrono::high_resolution_clock::now();
+		PerftThreadStats& stats = thread_stats[thread_index];
+		for (U64 i = next_root_move++; i < root_moves.size(); i = next_root_move++) {
+			root_nodes[i] = std::visit(PerftRootVisitor<P>{ root_moves[i], depth }, root);
+			stats.nodes += root_nodes[i];
+		}
+		stats.time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	U64 run(std::string fen) {
+		load_root(fen);
+		root_nodes.assign(root_moves.size(), 0ULL);
+		thread_stats.assign(thread_num, PerftThreadStats());
+		next_root_move = 0;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> threads;
+		for (U16 i = 0; i < thread_num; i++) {
+			if (pure) threads.emplace_back(&Perft_runner::perft_worker<PURE_GEN>, this, i);
+			else threads.emplace_back(&Perft_runner::perft_worker<HASH_GEN>, this, i);
+		}
+		for (auto& t : threads) t.join();
+		time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+		total_nodes = 0;
+		for (U64 nodes : root_nodes) total_nodes += nodes;
+		return total_nodes;
+	}
+
+	U64 kN_speed(U64 nodes, U64 time_ns) { return (U64)(nodes / std::max(time_ns / 1e6, 1e-3)); }
+
+	std::string results_str() {
+		std::stringstream out;
+		for (U64 i = 0; i < root_moves.size(); i++) {
+			std::string mv_str = root_moves[i].toString();
+			if (mv_str.back() == ' ') mv_str.pop_back();
+			out << mv_str << ": " << root_nodes[i] << "\n";
+		}
+		out << "\n";
+		for (U16 i = 0; i < thread_num; i++)
+			out << "Thread " << i << ": " << thread_stats[i].nodes << " nodes | " << kN_speed(thread_stats[i].nodes, thread_stats[i].time_taken) << " kN/s\n";
+		out << std::fixed << std::setprecision(2)
+			<< "Nodes searched: " << total_nodes << "\n"
+			<< "Speed: " << kN_speed(total_nodes, time_taken) << " kN/s | Total time: " << time_taken / 1e6 << " ms";
+		return out.str();
+	}
+};
+
+/*
+	Perft suite over the STS positions
+	Every STS line carries reference perft counts up to depth 7 in its third field ("1=45;2=1522;...").
+	Threads claim whole positions, each thread owns its own root states.
+*/
+
+constexpr U8 PERFT_SUITE_MAX_DEPTH = 7;
+
+// Their reference counts disagree with the legal moves already at depth 1, e.g. STS1 #37 has 38 legal moves and the data says 42
+constexpr std::array<std::string_view, 103> PERFT_SUITE_KNOWN_BAD = {
+	"STS1 #37", "STS1 #38", "STS1 #55", "STS1 #56", "STS1 #79", "STS1 #80",
+	"STS2 #13", "STS2 #29", "STS2 #31", "STS2 #32", "STS2 #33", "STS2 #34", "STS2 #35", "STS2 #36", "STS2 #39", "STS2 #44", "STS2 #45", "STS2 #63", "STS2 #72", "STS2 #75", "STS2 #76",
+	"STS3 #12", "STS3 #17", "STS3 #46", "STS3 #84", "STS3 #86", "STS3 #97",
+	"STS4 #41", "STS4 #57", "STS4 #61", "STS4 #66", "STS4 #70",
+	"STS5 #18", "STS5 #23", "STS5 #25", "STS5 #27", "STS5 #29", "STS5 #35", "STS5 #36", "STS5 #38", "STS5 #74",
+	"STS6 #34", "STS6 #35", "STS6 #36", "STS6 #41", "STS6 #43", "STS6 #44", "STS6 #78", "STS6 #79", "STS6 #80",
+	"STS7 #12", "STS7 #34", "STS7 #43", "STS7 #50", "STS7 #57", "STS7 #58", "STS7 #60", "STS7 #61", "STS7 #63", "STS7 #74", "STS7 #84",
+	"STS8 #52", "STS8 #54", "STS8 #55",
+	"STS9 #45", "STS9 #95", "STS9 #100",
+	"STS10 #27", "STS10 #29", "STS10 #34", "STS10 #36", "STS10 #40", "STS10 #46", "STS10 #47", "STS10 #49", "STS10 #50", "STS10 #53", "STS10 #73",
+	"STS12 #10", "STS12 #11", "STS12 #54", "STS12 #56", "STS12 #61", "STS12 #62", "STS12 #64", "STS12 #65", "STS12 #67", "STS12 #73",
+	"STS13 #13", "STS13 #16", "STS13 #35", "STS13 #48", "STS13 #49", "STS13 #72", "STS13 #74", "STS13 #79", "STS13 #84", "STS13 #85", "STS13 #88", "STS13 #92", "STS13 #93", "STS13 #96",
+	"STS14 #5"
+};
+
+struct PerftSuiteEntry {
+	std::string name;
+	std::string fen;
+	U64 expected_nodes = 0;
+	U64 nodes = 0;
+};
+
+class Perft_suite {
+public:
+	U8 depth;
+	U16 thread_num;
+	bool pure;
+
+	std::vector<PerftSuiteEntry> entries;
+	std::vector<std::string> missing_files;
+	U64 known_bad = 0;
+	std::atomic<U64> next_entry = 0;
+
+	U64 total_nodes = 0;
+	U64 time_taken = 0;
+
+	Perft_suite(U8 depth, U16 thread_num, bool pure) : depth(std::clamp(depth, (U8)1, PERFT_SUITE_MAX_DEPTH)), thread_num(std::max(thread_num, (U16)1)), pure(pure) {}
+
+	void load_entries() {
+		for (U8 sts_index = 1; sts_index <= 15; sts_index++) {
+			std::string file_name = "STS/STS" + std::to_string(sts_index) + ".cpd";
+			std::ifstream input(file_name);
+			if (!input.is_open()) { missing_files.push_back(file_name); continue; }
+
+			U16 line_num = 0;
+			for (std::string line; getline(input, line);) {
+				line_num++;
+				auto split_line = splitString(line, ',');
+				if (split_line.size() < 3) continue;
+
+				std::string name = "STS" + std::to_string(sts_index) + " #" + std::to_string(line_num);
+				if (std::find(PERFT_SUITE_KNOWN_BAD.begin(), PERFT_SUITE_KNOWN_BAD.end(), name) != PERFT_SUITE_KNOWN_BAD.end()) { known_bad++; continue; }
+
+				for (auto& depth_str : splitString(split_line[2], ';')) {
+					auto depth_split = splitString(depth_str, '=');
+					if (depth_split.size() < 2 || depth_split[1] == "" || std::stoi(depth_split[0]) != depth) continue;
+					entries.push_back({ name, split_line[0], std::stoull(depth_split[1]) });
+				}
+			}
+		}
+	}
+
+	template<MoveGenPolicy P>
+	void suite_worker() {
+		auto stw = std::make_unique<StateWhite>();
+		auto stb = std::make_unique<StateBlack>();
+		for (U64 i = next_entry++; i < entries.size(); i = next_entry++) {
+			PerftSuiteEntry& entry = entries[i];
+			if (splitString(entry.fen, ' ')[1] == "b") {
+				stb->loadFenString(entry.fen);
+				stb->perft_all_moves<P>(depth, entry.nodes);
+			}
+			else {
+				stw->loadFenString(entry.fen);
+				stw->perft_all_moves<P>(depth, entry.nodes);
+			}
+		}
+	}
+
+	void run() {
+		load_entries();
+		next_entry = 0;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> threads;
+		for (U16 i = 0; i < thread_num; i++) {
+			if (pure) threads.emplace_back(&Perft_suite::suite_worker<PURE_GEN>, this);
+			else threads.emplace_back(&Perft_suite::suite_worker<HASH_GEN>, this);
+		}
+		for (auto& t : threads) t.join();
+		time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+		total_nodes = 0;
+		for (auto& entry : entries) total_nodes += entry.nodes;
+	}
+
+	std::string results_str() {
+		std::stringstream out;
+		for (auto& file_name : missing_files) out << "Failed to open " << file_name << "\n";
+		if (entries.empty()) return out.str() + "No perft suite positions loaded, run it from the directory containing STS/";
+
+		U64 failures = 0;
+		for (auto& entry : entries) {
+			if (entry.nodes == entry.expected_nodes) continue;
+			failures++;
+			out << "Failed " << entry.name << ": " << entry.fen << " | Expected vs Real: " << entry.expected_nodes << " | " << entry.nodes << "\n";
+		}
+		out << std::fixed << std::setprecision(2)
+			<< "Perft suite at depth " << (U16)depth << ": " << entries.size() - failures << "/" << entries.size() << " positions passed\n"
+			<< "Skipped " << known_bad << " positions with known bad reference counts\n"
+			<< "Nodes searched: " << total_nodes << "\n"
+			<< "Speed: " << (U64)(total_nodes / std::max(time_taken / 1e6, 1e-3)) << " kN/s | Total time: " << time_taken / 1e6 << " ms";
+		return out.str();
+	}
+};
+
+// A missing depth uses the default, depths outside 1 to max_depth are clamped with a note
+U8 UCI::parse_perft_depth(std::vector<std::string>& split_msg, U64 index, U8 max_depth) {
+	if (index >= split_msg.size()) return std::min(PERFT_DEFAULT_DEPTH, max_depth);
+	int depth = std::stoi(split_msg[index]);
+	if (depth < 1 || depth > max_depth) {
+		depth = std::clamp(depth, 1, (int)max_depth);
+		uci_resp("info string Perft depth must be between 1 and " + std::to_string(max_depth) + ", using " + std::to_string(depth));
+	}
+	return (U8)depth;
+}
+
+// Runs on the search thread, the UCI loop keeps answering isready while any other command waits for the perft to finish
+void UCI::process_perft(std::vector<std::string> all_cmds) {
+	if (perft_running) { uci_resp("Perft already running"); return; }
+
+	U8 depth = parse_perft_depth(all_cmds, 2, PERFT_MAX_DEPTH);
+	bool pure = false; // Move generation only, without hashing and evaluation
+	U16 thread_num = (U16)std::max(std::thread::hardware_concurrency(), 1U);
+	for (U64 i = 3; i < all_cmds.size(); i++) {
+		if (all_cmds[i] == "pure") pure = true;
+		else if (all_cmds[i] == "threads" && i + 1 < all_cmds.size()) thread_num = (U16)std::stoi(all_cmds[++i]);
+	}
+
+	perft_running = true;
+	Perft_runner perft = Perft_runner(depth, thread_num, pure);
+	if (!pure) this->dtable.usePerftTable();
+	perft.run(std::visit(FenString(), stx));
+	if (!pure) this->dtable.useSearchTable();
+	uci_resp(perft.results_str());
+	perft_running = false;
+}
+
+void UCI::process_perftsuite(std::vector<std::string> split_msg) {
+	if (perft_running) { uci_resp("Perft already running"); return; }
+
+	U8 depth = parse_perft_depth(split_msg, 1, PERFT_SUITE_MAX_DEPTH);
+	bool pure = false;
+	U16 thread_num = (U16)std::max(std::thread::hardware_concurrency(), 1U);
+	for (U64 i = 2; i < split_msg.size(); i++) {
+		if (split_msg[i] == "pure") pure = true;
+		else if (split_msg[i] == "threads" && i + 1 < split_msg.size()) thread_num = (U16)std::stoi(split_msg[++i]);
+	}
+
+	perft_running = true;
+	Perft_suite suite = Perft_suite(depth, thread_num, pure);
+	if (!pure) this->dtable.usePerftTable();
+	suite.run();
+	if (!pure) this->dtable.useSearchTable();
+	uci_resp(suite.results_str());
+	perft_running = false;
+}
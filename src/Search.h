@@ -1,11 +1,15 @@
 #pragma once
 
 #include <chrono>
+#include <cstring>
 #include <numeric>
 #include <shared_mutex> 
+#include <atomic>
+#include <thread>
 #include <type_traits>
 #include <set>
 #include <map>
+#include <functional>
 
 #include "ChessConstants.h"
 #include "State.h"
@@ -29,6 +33,24 @@ struct SortedMove {
 	bool operator>(const SortedMove& other) const { return score_data > other.score_data; }
 };
 
+/*
+	Root moves
+	Every legal root move is searched once per pass, in the order left by the previous iteration. Moves that raised alpha
+	come first by score, the others by the nodes their subtree took since a move that was expensive to refute is the likely
+	next best move. The node counts of the best move also go to the time management.
+*/
+
+struct RootMove {
+	Move mv;
+	I16 score = EVAL_NONE;
+	U64 nodes = 0;
+	std::vector<Move> pv;
+
+	RootMove(Move mv) : mv(mv) {}
+
+	bool operator>(const RootMove& other) const { return (score != other.score) ? score > other.score : nodes > other.nodes; }
+};
+
 struct SearchStats {
 	U64 total_nodes;
 	U64 total_qnodes;
@@ -47,7 +69,7 @@ struct SearchStats {
 	SearchStats() : total_nodes(0), total_qnodes(0), nodes_searched(0), zobrist_hits(0), time_taken(0), tests_done(0) {}
 
 	void reset() {
-		time_started = std::chrono::high_resolution_clock::now();
+		time_started = std::chrono::steady_clock::now();
 
 		zobrist_hits = 0;
 		total_nodes = 0;
@@ -61,7 +83,7 @@ struct SearchStats {
 	}
 
 	void finish() {
-		time_taken  = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - time_started).count();
+		time_taken  = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - time_started).count();
 	}
 
 	double get_mean(std::vector<double>& vec) { return vec.empty() ? (double)0 : std::accumulate(vec.begin(), vec.end(), (double)0) / vec.size(); }
@@ -120,19 +142,278 @@ struct SMP_Package {
 	void unlock() { alpha_beta_lock->unlock(); }
 };
 
+/*
+	Time package
+	The stop flag is set by the UCI thread on stop and quit, or by the search itself once the hard limit passes.
+	The clock and the node limit are only checked every TIME_POLL_NODES nodes, the stop flag itself at every negamax node.
+	A ponder search has no deadline until the UCI thread clears the pondering flag on ponderhit,
+	the search thread then starts the normal time budget from that moment without restarting the search.
+
+	Between iterations the soft limit decides whether to go on. It grows when the best move changes or the score drops
+	and shrinks while the best move stays the same. An iteration that is predicted to overrun the hard limit, from the
+	last iteration time and the branching factor measured in nodes, is not started since its result would be discarded.
+*/
+
+constexpr U64 TIME_POLL_NODES = 1024;
+constexpr U64 MOVE_OVERHEAD = 30;
+constexpr U64 DEFAULT_MOVES_TO_GO = 30;
+
+struct TimeControl {
+	U64 time_left = 0;
+	U64 increment = 0;
+	U64 moves_to_go = 0;
+	U64 move_time = 0;
+};
+
+/*
+	Search limits
+	Limits of go besides the clock, a depth of 100 is unlimited. Root moves are restricted to searchmoves when it is not empty.
+	The number of PVs is the MultiPV option, it is passed along with the limits since the search object is replaced on debug.
+*/
+
+constexpr U8 MAX_SEARCH_DEPTH = 100;
+constexpr U8 MAX_MULTI_PV = 64;
+
+// Check extensions and quiescence can go past the search depth, deeper nodes return their static evaluation
+constexpr U8 MAX_PLY = 128;
+
+struct SearchLimits {
+	U8 depth = MAX_SEARCH_DEPTH;
+	U64 nodes = 0;
+	U8 mate = 0;
+	U8 multi_pv = 1;
+	std::vector<Move> search_moves;
+};
+
 struct TimePackage {
-	U64 time_left;
 	U64 max_thinking_time = 5000;
-	bool stop_searching = false;
+	std::atomic<bool> stop_searching = false;
+	std::atomic<bool> pondering = false;
+
+	U64 soft_limit = 0;
+	U64 hard_limit = 0;
+	bool fixed_time = false;
+
+	bool has_deadline = false;
+	bool waiting_for_ponderhit = false;
+	std::chrono::steady_clock::time_point budget_start;
+	std::chrono::steady_clock::time_point deadline;
+
+	// Negamax and quiescence nodes of the current search, a node limit of 0 is unlimited
+	U64 nodes = 0;
+	U64 next_poll = TIME_POLL_NODES;
+	U64 node_limit = 0;
+
+	// Iteration history for the soft limit and the prediction of the next iteration
+	std::chrono::steady_clock::time_point iteration_start;
+	U64 iteration_start_nodes = 0;
+	U64 last_iteration_nodes = 0;
+	Move last_best_move;
+	I16 last_score = EVAL_NONE;
+	U8 stable_iterations = 0;
+
+	TimePackage() {}
+	TimePackage(const TimePackage& oth) : max_thinking_time(oth.max_thinking_time) {}
+	TimePackage& operator=(const TimePackage& oth) {
+		max_thinking_time = oth.max_thinking_time;
+		return *this;
+	}
+
+	// The clock is spread over the expected number of moves, the hard limit allows overruns of the soft limit on unstable moves
+	void set_time_control(TimeControl tc) {
+		if (tc.move_time) {
+			set_fixed_time(tc.move_time);
+			return;
+		}
+		fixed_time = false;
+		U64 available = (tc.time_left > 2 * MOVE_OVERHEAD) ? tc.time_left - MOVE_OVERHEAD : tc.time_left / 2;
+		U64 moves_to_go = tc.moves_to_go ? std::min(tc.moves_to_go, DEFAULT_MOVES_TO_GO) : DEFAULT_MOVES_TO_GO;
+
+		soft_limit = std::min(available / moves_to_go + tc.increment * 3 / 4, available / 2);
+		hard_limit = std::max(soft_limit, std::min(soft_limit * 4, available * 3 / 4));
+		soft_limit = std::max(soft_limit, (U64)1);
+		hard_limit = std::max(hard_limit, (U64)1);
+	}
+
+	// Used until the deadline, the next iteration might still finish in time
+	void set_fixed_time(U64 move_time) {
+		fixed_time = true;
+		U64 limit = (move_time > 2 * MOVE_OVERHEAD) ? move_time - MOVE_OVERHEAD : std::max(move_time / 2, (U64)1);
+		soft_limit = limit;
+		hard_limit = limit;
+	}
+
+	// Only resets the deadline, a stop requested before the search thread picked up the search is kept
+	void start() {
+		has_deadline = true;
+		waiting_for_ponderhit = false;
+		budget_start = std::chrono::steady_clock::now();
+		deadline = budget_start + std::chrono::milliseconds(hard_limit);
+	}
+
+	void start_timed() {
+		start();
+		reset_iterations();
+	}
+
+	void start_infinite() {
+		has_deadline = false;
+		waiting_for_ponderhit = false;
+		reset_iterations();
+	}
+
+	void start_ponder() {
+		start_infinite();
+		waiting_for_ponderhit = true;
+	}
+
+	void reset_iterations() {
+		nodes = 0;
+		next_poll = TIME_POLL_NODES;
+		iteration_start = std::chrono::steady_clock::now();
+		iteration_start_nodes = 0;
+		last_iteration_nodes = 0;
+		last_best_move = Move();
+		last_score = EVAL_NONE;
+		stable_iterations = 0;
+	}
 
-	void reset(U64 time_left_arg) {
-		stop_searching = false;
-		this->time_left = time_left_arg;
+	// Picks up a ponderhit, returns true once the time budget runs
+	bool check_ponderhit() {
+		if (waiting_for_ponderhit && !pondering.load(std::memory_order_relaxed)) start();
+		return !waiting_for_ponderhit;
 	}
 
-	U64 get_allocated_time() { return time_left / 20; }
+	bool poll() {
+		if (++nodes >= next_poll) {
+			next_poll = nodes + TIME_POLL_NODES;
+			bool out_of_time = check_ponderhit() && has_deadline && std::chrono::steady_clock::now() >= deadline;
+			if (out_of_time || (node_limit && nodes >= node_limit)) stop_searching.store(true, std::memory_order_relaxed);
+		}
+		return stop_searching.load(std::memory_order_relaxed);
+	}
+
+	// Called after every finished iteration, the history is kept up to date while pondering but only used after ponderhit
+	bool iteration_done(Move best_move, I16 score, U64 best_move_nodes) {
+		auto now = std::chrono::steady_clock::now();
+		if (!waiting_for_ponderhit && iteration_start < budget_start) iteration_start = budget_start;
+		U64 iteration_time = std::chrono::duration_cast<std::chrono::milliseconds>(now - iteration_start).count();
+		U64 iteration_nodes = nodes - iteration_start_nodes;
+
+		bool first_iteration = (last_score == EVAL_NONE);
+		stable_iterations = (!first_iteration && best_move == last_best_move) ? std::min(stable_iterations + 1, 10) : 0;
+		I32 score_drop = first_iteration ? 0 : std::clamp(last_score - score, 0, 200);
+
+		U64 previous_nodes = last_iteration_nodes;
+		iteration_start = now;
+		iteration_start_nodes = nodes;
+		last_iteration_nodes = iteration_nodes;
+		last_best_move = best_move;
+		last_score = score;
+
+		if (waiting_for_ponderhit || !has_deadline || fixed_time) return false;
+
+		I32 scale = 100;
+		if (!first_iteration) scale += (stable_iterations == 0) ? 40 : -5 * std::min((I32)stable_iterations, 8);
+		if (score_drop > 15) scale += score_drop / 2;
+		// The other moves were refuted quickly when the best move took nearly all nodes of the iteration
+		if (iteration_nodes && best_move_nodes * 100 / iteration_nodes >= 90) scale -= 15;
+		U64 scaled_soft_limit = std::min(soft_limit * scale / 100, hard_limit);
+
+		U64 elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - budget_start).count();
+		if (elapsed >= scaled_soft_limit) return true;
+
+		U64 branching_factor = previous_nodes ? std::clamp(iteration_nodes / previous_nodes, (U64)2, (U64)6) : 4;
+		return elapsed + iteration_time * branching_factor > hard_limit;
+	}
+};
+
+/*
+	Evaluation cache
+	Small per thread table of static evaluations keyed by zobrist hash, sized to stay in L2.
+	Transpositions and re-searches of a position reuse its evaluation instead of computing it again.
+*/
+
+constexpr U64 EVAL_CACHE_SIZE = 1ULL << 15;
+constexpr U64 EVAL_CACHE_SIZE_ROOT = EVAL_CACHE_SIZE - 1;
+
+struct EvalCacheEntry {
+	U32 hash = 0;
+	I16 eval = EVAL_NONE;
+};
+
+struct EvalCache {
+	std::vector<EvalCacheEntry> entries = std::vector<EvalCacheEntry>(EVAL_CACHE_SIZE);
+
+	void clear() { std::fill(entries.begin(), entries.end(), EvalCacheEntry()); }
+
+	I16 probe(U64 zhash) {
+		EvalCacheEntry& entry = entries[zhash & EVAL_CACHE_SIZE_ROOT];
+		return (entry.hash == (U32)(zhash >> 32)) ? entry.eval : EVAL_NONE;
+	}
+
+	void store(U64 zhash, I16 eval) {
+		EvalCacheEntry& entry = entries[zhash & EVAL_CACHE_SIZE_ROOT];
+		entry.hash = (U32)(zhash >> 32);
+		entry.eval = eval;
+	}
+};
+
+/*
+	Correction history
+	Per thread table of how far the static evaluation was off from the search result, keyed by side to move and pawn structure.
+	Entries are kept in fixed point and move towards the observed error with a weight growing with the search depth.
+*/
+
+constexpr U64 CORRECTION_SIZE = 1ULL << 14;
+constexpr U64 CORRECTION_SIZE_ROOT = CORRECTION_SIZE - 1;
+constexpr I32 CORRECTION_GRAIN = 256;
+constexpr I32 CORRECTION_WEIGHT_SCALE = 256;
+constexpr I32 CORRECTION_LIMIT = 64 * CORRECTION_GRAIN;
+
+struct CorrectionHistory {
+	std::vector<I32> entries = std::vector<I32>(2 * CORRECTION_SIZE);
+
+	void clear() { std::fill(entries.begin(), entries.end(), 0); }
+
+	I32& get_entry(U8 turn, U64 pawn_zhash) { return entries[(turn * CORRECTION_SIZE) + (pawn_zhash & CORRECTION_SIZE_ROOT)]; }
+
+	I16 correct(U8 turn, U64 pawn_zhash, I16 eval) {
+		I32 corrected = eval + get_entry(turn, pawn_zhash) / CORRECTION_GRAIN;
+		return (I16)std::clamp(corrected, (I32)INT16_MIN + 256, (I32)INT16_MAX - 256);
+	}
+
+	void update(U8 turn, U64 pawn_zhash, I16 error, I8 depth) {
+		I32& entry = get_entry(turn, pawn_zhash);
+		I32 weight = std::min(depth + 1, 16);
+		entry = (entry * (CORRECTION_WEIGHT_SCALE - weight) + error * CORRECTION_GRAIN * weight) / CORRECTION_WEIGHT_SCALE;
+		entry = std::clamp(entry, -CORRECTION_LIMIT, CORRECTION_LIMIT);
+	}
 };
 
+// Mate scores count down from the bounds of I16, anything this close to them is a mate
+constexpr bool is_mate_score(I16 score) { return score <= INT16_MIN + 256 || score >= INT16_MAX - 256; }
+
+// Full moves until the mate, negative when the side to move gets mated
+constexpr I16 mate_in_moves(I16 score) { return (score > 0) ? (INT16_MAX - score + 2) / 2 : -(score - INT16_MIN + 1) / 2; }
+
+/*
+	Mate scores count the plies from the root, the search table stores them counted from the position itself
+	so a transposition at another ply still gets the right distance. Bounds at the edge of the range are clamped,
+	which only loosens them.
+*/
+constexpr I16 score_to_tt(I16 score, U8 ply) {
+	if (score >= INT16_MAX - 256) return (I16)std::min((I32)score + ply, (I32)INT16_MAX);
+	if (score <= INT16_MIN + 256) return (I16)std::max((I32)score - ply, (I32)INT16_MIN + 1);
+	return score;
+}
+
+constexpr I16 score_from_tt(I16 score, U8 ply) {
+	if (score >= INT16_MAX - 256) return score - ply;
+	if (score <= INT16_MIN + 256) return score + ply;
+	return score;
+}
+
 struct Regular;
 struct Debug;
 #define IF_DEBUG if constexpr (std::is_same<T, Debug>::value)
@@ -141,50 +422,148 @@ template <class T>
 class Search {
 public:
 	std::vector<SortedMove> best_moves;
+	std::vector<RootMove> root_moves;
+	// PVs of the last finished iteration, in the order of best_moves
+	std::vector<std::vector<Move>> pv_lines;
 	std::map<U64, U8> repetition_map;
 
 	TimePackage time_pkg;
+	SearchLimits limits;
 	SearchStats stats;
-	U64 current_search_ID;
 	U8 start_depth;
 
 	Move killer_moves[2][64];
+	Move pv_table[MAX_PLY][MAX_PLY];
+	U8 pv_length[MAX_PLY] = {};
 	I16 history_moves[12][64] = {};
+	EvalCache eval_cache;
+	CorrectionHistory correction_history;
+
+	// Receives the info lines of every finished iteration, searches without it are silent
+	std::function<void(std::string)> info_output;
 
 	Search() : start_depth(0) {}
 
 	bool is_debug() { return std::is_same<T, Debug>::value; }
 
-	bool should_stop_searching(std::chrono::steady_clock::time_point& start, I64& max_time) {
-		auto time_passed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
-		max_time -= time_passed;
-		start = std::chrono::high_resolution_clock::now();
-		return (time_pkg.stop_searching || (max_time < time_passed * 3));
+	// Time spent pondering is not part of the budget, it only starts counting at ponderhit
+	bool should_stop_searching(StateMix& stx) {
+		if (time_pkg.stop_searching) return true;
+		time_pkg.check_ponderhit();
+		I16 score = best_moves.empty() ? EVAL_NONE : best_moves.begin()->score();
+		U64 best_move_nodes = root_moves.empty() ? 0 : root_moves.begin()->nodes;
+		return time_pkg.iteration_done(get_best_move(stx), score, best_move_nodes);
 	}
 
-	void search_reset() {
+	void search_reset(StateMix& stx) {
 		best_moves.clear();
+		pv_lines.clear();
+		init_root_moves(stx);
 		stats.reset();
 		std::memset(history_moves, 0, sizeof(history_moves));
 		std::memset(killer_moves, 0, sizeof(killer_moves));
 	}
 
-	Move timed_search(StateMix& stx, U64 time_allocated) {
-		search_reset(); 
-		start_timer(time_allocated);
-		negamax_iterative_timed(stx, time_allocated);
+	// Uses the limits set with the time control
+	Move timed_search(StateMix& stx) {
+		search_reset(stx);
+		if (time_pkg.pondering) time_pkg.start_ponder();
+		else time_pkg.start_timed();
+		negamax_iterative_timed(stx);
+
+		// The best move can only be sent once the opponent made the expected move or the GUI stopped the ponder search
+		while (time_pkg.pondering && !time_pkg.stop_searching) std::this_thread::sleep_for(std::chrono::milliseconds(1));
 		stats.finish();
-		this->current_search_ID++;
-		//std::cerr << "Best move score: " << best_moves.begin()->score << "\n";
-		return best_moves.begin()->mv();
+		return get_best_move(stx);
 	}
 
 	Move depth_search(StateMix& stx, U8 depth) {
-		search_reset();
-		time_pkg.reset(0);
+		search_reset(stx);
+		time_pkg.start_infinite();
 		negamax_iterative(stx, depth);
 		stats.finish();
-		return best_moves.begin()->mv();
+		return get_best_move(stx);
+	}
+
+	// Runs until the UCI thread sets the stop flag or one of the search limits is reached
+	Move infinite_search(StateMix& stx) {
+		return depth_search(stx, MAX_SEARCH_DEPTH);
+	}
+
+	// A search stopped before the first iteration finished has no scored moves yet, any legal move is better than none
+	Move get_best_move(StateMix& stx) {
+		if (!best_moves.empty()) return best_moves.begin()->mv();
+		State& st = *std::visit(StateCast(), stx);
+		for (Move* mv = st.move_arr; mv != st.move_iter; mv++)
+			if (is_search_move(*mv)) return *mv;
+		return Move();
+	}
+
+	// The node limit goes through the time package. Mate searches are not capped in depth, they end once a short enough mate is proven.
+	void set_limits(SearchLimits new_limits) {
+		limits = new_limits;
+		time_pkg.node_limit = limits.nodes;
+	}
+
+	void init_root_moves(StateMix& stx) {
+		State& st = *std::visit(StateCast(), stx);
+		root_moves.clear();
+		for (Move* mv = st.move_arr; mv != st.move_iter; mv++)
+			if (is_search_move(*mv)) root_moves.push_back(RootMove(*mv));
+	}
+
+	bool is_search_move(Move mv) {
+		return limits.search_moves.empty() || std::find(limits.search_moves.begin(), limits.search_moves.end(), mv) != limits.search_moves.end();
+	}
+
+	bool mate_found() {
+		if (!limits.mate || best_moves.empty()) return false;
+		I16 score = best_moves.begin()->score();
+		return score >= INT16_MAX - 256 && mate_in_moves(score) <= limits.mate;
+	}
+
+	/*
+		Static evaluation, the caller passes the one stored in the search table entry of the position it already probed.
+		Otherwise the NNUE is looked up in the eval cache first, the PeSTo evaluation is cheaper than probing it.
+	*/
+	I16 static_eval(State& st, I16 stored_eval = EVAL_NONE) {
+		if (stored_eval != EVAL_NONE) return stored_eval;
+		if (!st.data_table->use_nnue) return st.get_eval();
+		I16 eval = eval_cache.probe(st.zobrist_hash);
+		if (eval != EVAL_NONE) return eval;
+
+		eval = st.get_eval();
+		eval_cache.store(st.zobrist_hash, eval);
+		return eval;
+	}
+
+	// Static evaluation adjusted by the correction history, used for the pruning decisions
+	I16 corrected_eval(State& st, I16 eval) { return correction_history.correct(st.turn, st.pawn_zhash, eval); }
+
+	// Only quiet results are used, captures and promotions are not a bias of the static evaluation
+	void update_correction(State& st, I16 eval, I16 score, U8 node_type, Move best_move, I8 depth) {
+		if (st.in_check || time_pkg.stop_searching || is_mate_score(score)) return;
+		if (node_type != HASH_ALPHA && (st.squareOcc[best_move.to()] != EMPTY_ID || best_move.promotion() != 0)) return;
+		if (node_type == HASH_BETA && score <= eval) return;
+		if (node_type == HASH_ALPHA && score >= eval) return;
+		correction_history.update(st.turn, st.pawn_zhash, score - eval, depth);
+	}
+
+	// Expected reply to the best move, the second move of the PV or else the search table move of the position after it
+	Move get_ponder_move(StateMix& stx, Move best_move) {
+		if (!pv_lines.empty() && pv_lines[0].size() > 1 && pv_lines[0][0] == best_move) return pv_lines[0][1];
+		State& st = *std::visit(StateCast(), stx);
+		if (st.move_iter == st.move_arr) return Move();
+
+		AlignedState aligned_st;
+		StateMix next_stx = std::visit(MoveVisitor{ best_move, &aligned_st }, stx);
+		State& next_st = *std::visit(StateCast(), next_stx);
+		HTableEntry& zentry = next_st.data_table->get_zobrist_entry(next_st.zobrist_hash);
+		if (!zentry.softEquals(next_st.zobrist_hash)) return Move();
+
+		for (Move* mv = next_st.move_arr; mv != next_st.move_iter; mv++)
+			if (*mv == zentry.best_move) return *mv;
+		return Move();
 	}
 
 	bool hasTripleRepetition() {
@@ -225,24 +604,14 @@ public:
 		stats.nodes_searched = 0ULL;
 	}
 
-	void start_timer(U64 time_allocated) {
-		std::thread t(&Search<T>::start_timeout_sleep, this, time_allocated, current_search_ID);
-		t.detach();
-	}
-
-	void start_timeout_sleep(U64 time_allocated, U64 search_ID) {
-		std::this_thread::sleep_for(std::chrono::milliseconds(time_allocated));
-		if (this->current_search_ID == search_ID) time_pkg.stop_searching = true;	
-	}
-
-	void negamax_iterative_timed(StateMix& stx, I64 max_time) {
+	void negamax_iterative_timed(StateMix& stx) {
 		U64 previous_nodes = 0ULL;
 
-		auto start = std::chrono::high_resolution_clock::now();
-		for (start_depth = 2; start_depth <= 100; start_depth++) {
+		for (start_depth = 2; start_depth <= limits.depth; start_depth++) {
 			negamax_start_threaded(stx);
-			if (should_stop_searching(start, max_time)) {
-				std::cerr << "Searched until depth: " << (U64)start_depth << " | Best move: " << best_moves.begin()->mv().toString() << "\n";
+			if (!time_pkg.stop_searching) report_iteration(stx);
+			if (should_stop_searching(stx) || mate_found()) {
+				std::cerr << "Searched until depth: " << (U64)start_depth << " | Best move: " << get_best_move(stx).toString() << "\n";
 				return;
 			}
 			IF_DEBUG this->update_stats(previous_nodes);
@@ -251,84 +620,136 @@ public:
 
 	void negamax_iterative(StateMix& stx, U8 depth) {
 		U64 previous_nodes = 0ULL;
-		for (start_depth = 2; start_depth <= depth; start_depth++) {
+		depth = std::min(depth, limits.depth);
+		for (start_depth = 2; start_depth <= depth && !time_pkg.stop_searching; start_depth++) {
 			negamax_start_threaded(stx);
+			if (!time_pkg.stop_searching) report_iteration(stx);
 			IF_DEBUG this->update_stats(previous_nodes);
+			if (mate_found()) break;
 		}
 	}
 
-	void starting_move_search(StateMix& stx, Move mv, I16& alpha, I16& beta) {
+	void starting_move_search(StateMix& stx, RootMove& root_move, I16& alpha, I16& beta) {
+		U64 start_nodes = time_pkg.nodes;
 		I16 score = 0;
 		AlignedState aligned_st;
-		StateMix next_stx = std::visit(MoveVisitor{ mv, &aligned_st }, stx);
+		StateMix next_stx = std::visit(MoveVisitor{ root_move.mv, &aligned_st }, stx);
 
+		pv_length[1] = 0;
 		if (isRepetitionDraw(next_stx)) score = 0;
 		else if (alpha != INT16_MIN + 1) 
-			score = -negamax(-alpha - 1, -alpha, start_depth - 1, next_stx); // PV search
+			score = -negamax(-alpha - 1, -alpha, start_depth - 1, 1, next_stx); // PV search
 		if (alpha == INT16_MIN + 1 || (score > alpha) && (score < beta)) 
-			score = -negamax(-beta, -alpha, start_depth - 1, next_stx);
+			score = -negamax(-beta, -alpha, start_depth - 1, 1, next_stx);
 
+		root_move.nodes += time_pkg.nodes - start_nodes;
 		if (score > alpha) {
 			alpha = score;
-			this->best_moves.push_back({ mv, score });
+			root_move.score = score;
+			root_move.pv = { root_move.mv };
+			root_move.pv.insert(root_move.pv.end(), pv_table[1], pv_table[1] + pv_length[1]);
 		}
 	};
 
-	void negamax_start_threaded(StateMix& stx, I16 alpha = INT16_MIN+1, I16 beta = INT16_MAX) {
-		if (time_pkg.stop_searching) return;
-		State& st = *std::visit(StateCast(), stx);
-		if (st.move_iter == st.move_arr) return;
+	/*
+		With MultiPV every PV gets its own pass over the root moves that are not a PV yet, searched with a full window
+		so its score is exact. The passes share the search table, the later ones mostly re-search positions it already holds.
+		Each pass sorts the moves it searched, after the iteration the PVs lead the root moves and make up best_moves.
+	*/
+	void negamax_start_threaded(StateMix& stx) {
+		if (time_pkg.stop_searching || root_moves.empty()) return;
 
 		auto best_moves_copy = best_moves;
 		best_moves.clear();
+		for (auto& root_move : root_moves) root_move.nodes = 0;
+
+		U64 pv_count = std::min((U64)limits.multi_pv, (U64)root_moves.size());
+		for (U64 pv_index = 0; pv_index < pv_count && !time_pkg.stop_searching; pv_index++) {
+			I16 alpha = INT16_MIN + 1, beta = INT16_MAX;
+			auto pass_begin = root_moves.begin() + pv_index;
+			for (auto root_move = pass_begin; root_move != root_moves.end(); root_move++) root_move->score = EVAL_NONE;
+			for (auto root_move = pass_begin; root_move != root_moves.end(); root_move++) starting_move_search(stx, *root_move, alpha, beta);
+
+			std::stable_sort(pass_begin, root_moves.end(), std::greater<RootMove>());
+			if (pass_begin->score == EVAL_NONE) break;
+			best_moves.push_back({ pass_begin->mv, pass_begin->score });
+		}
 
-		for (auto mv : best_moves_copy)
-			starting_move_search(stx, mv.mv(), alpha, beta);
-		for (Move* mv = st.move_arr; mv != st.move_iter; mv++) 
-			starting_move_search(stx, *mv, alpha, beta);
-		
-		std::sort(best_moves.begin(), best_moves.end(), std::greater<SortedMove>());
+		// Search was not fully finished, use previous results unless there are none
+		if (time_pkg.stop_searching && !best_moves_copy.empty()) best_moves = best_moves_copy;
+		else if (!time_pkg.stop_searching) {
+			pv_lines.clear();
+			for (U64 i = 0; i < best_moves.size(); i++) pv_lines.push_back(root_moves[i].pv);
+		}
+	}
+
+	// UCI wants mates in full moves and negative ones when we are mated
+	std::string uci_score(I16 score) {
+		if (is_mate_score(score)) return "mate " + std::to_string(mate_in_moves(score));
+		return "cp " + std::to_string(score);
+	}
 
-		// Search was not fully finished, use previous results
-		if (time_pkg.stop_searching) best_moves = best_moves_copy;
+	// Triangular PV table, the PV of a node is its best move followed by the PV of the child it leads to
+	void update_pv(U8 ply, Move mv) {
+		pv_table[ply][0] = mv;
+		std::copy(pv_table[ply + 1], pv_table[ply + 1] + pv_length[ply + 1], pv_table[ply] + 1);
+		pv_length[ply] = pv_length[ply + 1] + 1;
 	}
 
-	I16 evalScoreTPT(HTableEntry& zentry, I16 alpha, I16 beta, U8 depth) {
+	void report_iteration(StateMix& stx) {
+		if (!info_output) return;
+		U64 time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - stats.time_started).count();
+		std::string search_info = " nodes " + std::to_string(time_pkg.nodes) + " nps " + std::to_string(time_pkg.nodes * 1000 / std::max(time_ms, (U64)1)) + " time " + std::to_string(time_ms);
+
+		U64 pv_count = std::min((U64)limits.multi_pv, (U64)pv_lines.size());
+		for (U64 i = 0; i < pv_count; i++) {
+			std::string line = "info depth " + std::to_string(start_depth) + " multipv " + std::to_string(i + 1) + " score " + uci_score(best_moves[i].score()) + search_info + " pv";
+			for (Move mv : pv_lines[i]) line += " " + mv.toUciString();
+			info_output(line);
+		}
+	}
+
+	I16 evalScoreTPT(HTableEntry& zentry, I16 alpha, I16 beta, U8 depth, U8 ply) {
 		if (!zentry.is_quiesecent() && zentry.depth() >= depth) {
 			U8 node_type = zentry.node_type();
-			if (node_type == HASH_EXACT) return zentry.score;
-			else if (node_type == HASH_ALPHA && zentry.score <= alpha) return alpha;
-			else if (node_type == HASH_BETA && zentry.score >= beta) return beta;
+			I16 score = score_from_tt(zentry.score, ply);
+			if (node_type == HASH_EXACT) return score;
+			else if (node_type == HASH_ALPHA && score <= alpha) return alpha;
+			else if (node_type == HASH_BETA && score >= beta) return beta;
 		}
 		return INT16_MAX;
 	}
 
-	I16 evalScoreQuiescenceTPT(HTableEntry& zentry, I16 alpha, I16 beta, U8 depth) {
+	I16 evalScoreQuiescenceTPT(HTableEntry& zentry, I16 alpha, I16 beta, U8 depth, U8 ply) {
 		if (zentry.depth() >= depth) {
 			U8 node_type = zentry.node_type();
-			if (node_type == HASH_EXACT) return zentry.score;
-			else if (node_type == HASH_ALPHA && zentry.score <= alpha) return alpha;
-			else if (node_type == HASH_BETA && zentry.score >= beta) return beta;
+			I16 score = score_from_tt(zentry.score, ply);
+			if (node_type == HASH_EXACT) return score;
+			else if (node_type == HASH_ALPHA && score <= alpha) return alpha;
+			else if (node_type == HASH_BETA && score >= beta) return beta;
 		}
 		return INT16_MAX;
 	}
 
-	I16 negamax(I16 alpha, I16 beta, I8 depth, StateMix& stx) {
+	// The ply is the distance to the root, unlike the depth it is not changed by the check extension
+	I16 negamax(I16 alpha, I16 beta, I8 depth, U8 ply, StateMix& stx) {
 		IF_DEBUG stats.nodes_searched++;
 		State& st = *std::visit(StateCast(), stx);
-		if (time_pkg.stop_searching) return st.get_eval();
+		pv_length[ply] = 0;
+		if (time_pkg.poll() || ply >= MAX_PLY - 1) return static_eval(st);
 
 		if (st.move_iter == st.move_arr) {
-			if (st.in_check) return INT16_MIN + (start_depth - depth);
+			if (st.in_check) return INT16_MIN + ply;
 			else return 0;
 		}
+		if (st.is_material_draw()) return 0;
 
 		// Search extension
 		if (st.in_check) depth++;
 
 		if (depth <= 1) { 
 			IF_DEBUG stats.nodes_searched += st.move_iter - st.move_arr;
-			return quiescent(alpha, beta, 10, stx);
+			return quiescent(alpha, beta, 10, ply, stx);
 		}
 
 		Move best_move_local;
@@ -336,16 +757,27 @@ public:
 		I16 best_score = INT16_MIN + 1;
 		I16 score;
 
+		// A cutoff from the search table does not need the static evaluation, so the table is probed first
+		HTableEntry& zentry_og = st.data_table->get_zobrist_entry(st.zobrist_hash);
+		HTableEntry zentry = zentry_og;
+		bool zobrist_hit = zentry.softEquals(st.zobrist_hash);
+		if (zobrist_hit) {
+			IF_DEBUG stats.zobrist_hits++;
+			I16 stored_score = evalScoreTPT(zentry, alpha, beta, depth, ply);
+			if (stored_score != INT16_MAX && (beta - alpha == 1 || stored_score <= alpha || stored_score >= beta)) { return stored_score; }
+		}
+
+		I16 eval = st.in_check ? EVAL_NONE : static_eval(st, zobrist_hit ? zentry.static_eval : EVAL_NONE);
+		I16 pruning_eval = st.in_check ? EVAL_NONE : corrected_eval(st, eval);
+
 		AlignedState aligned_st;
-		if (!st.null_move && !st.in_check) {
+		// Null move is unreliable while the enemy has a lot of pressure around our king
+		if (!st.null_move && !st.in_check && pruning_eval >= beta && st.get_king_zone_pressure() < 5) {
 			StateMix next_stx = std::visit(NullMoveVisitor{ &aligned_st }, stx);
-			score = -negamax(-beta, -beta + 1, depth - 3, next_stx);
+			score = -negamax(-beta, -beta + 1, depth - 3, ply + 1, next_stx);
 			if (score >= beta) return beta;
 		}
 
-		HTableEntry& zentry_og = st.data_table->get_zobrist_entry(st.zobrist_hash);
-		HTableEntry zentry = zentry_og;
-
 		auto process_score = [&](I16 score, Move mv) {
 			if (score > alpha) {
 				if (st.squareOcc[mv.to()] == EMPTY_ID) 
@@ -354,6 +786,7 @@ public:
 				node_type = HASH_EXACT;
 				best_score = score;
 				best_move_local = mv;
+				update_pv(ply, mv);
 			}
 			else if (score > best_score) {
 				best_score = score;
@@ -362,30 +795,24 @@ public:
 		};
 
 		auto set_zentry = [&] (I16 score, U8 node_type, Move mv) {
+			zentry.static_eval = eval;
 			zentry.setHash(st.zobrist_hash);
 			zentry.setTypeAndDepth(node_type, depth);
 			zentry.best_move = mv;
-			zentry.score = score;
+			zentry.score = score_to_tt(score, ply);
 			zentry_og = zentry;
 		};
 
 		auto PV_search = [&](Move mv) {
 			StateMix next_stx = std::visit(MoveVisitor{ mv, &aligned_st }, stx);
 			if (node_type == HASH_EXACT) {
-				score = -negamax(-alpha - 1, -alpha, depth - 1, next_stx);
+				score = -negamax(-alpha - 1, -alpha, depth - 1, ply + 1, next_stx);
 				if ((score > alpha) && (score < beta))
-					score = -negamax(-beta, -alpha, depth - 1, next_stx);
+					score = -negamax(-beta, -alpha, depth - 1, ply + 1, next_stx);
 			}
-			else score = -negamax(-beta, -alpha, depth - 1, next_stx);
+			else score = -negamax(-beta, -alpha, depth - 1, ply + 1, next_stx);
 		};
 
-		bool zobrist_hit = zentry.softEquals(st.zobrist_hash);
-		if (zobrist_hit) {
-			IF_DEBUG stats.zobrist_hits++;
-			I16 stored_score = evalScoreTPT(zentry, alpha, beta, depth);
-			if (stored_score != INT16_MAX) { return stored_score; }
-		}
-
 		std::vector<SortedMove> moves = sort_moves<true>(st, depth, zentry, zobrist_hit);
 		for (auto& smv : moves) {
 			Move mv = smv.mv();
@@ -400,37 +827,46 @@ public:
 					}
 				}
 				set_zentry(beta, HASH_BETA, mv);
+				update_correction(st, eval, beta, HASH_BETA, mv, depth);
 				return beta;
 			}
 			process_score(score, mv);
 		}
 
 		if (!zobrist_hit || zentry.depth() <= depth) set_zentry(alpha, node_type, best_move_local);
+		update_correction(st, eval, alpha, node_type, best_move_local, depth);
 
 		return alpha;
 	}
 
-	I16 quiescent(I16 alpha, I16 beta, I8 depth, StateMix& stx) {
+	// Keeps the PV going through the captures, otherwise a mate found in quiescence would end the PV early
+	I16 quiescent(I16 alpha, I16 beta, I8 depth, U8 ply, StateMix& stx) {
 		State& st = *std::visit(StateCast(), stx);
+		time_pkg.nodes++;
+		pv_length[ply] = 0;
+		if (ply >= MAX_PLY - 1) return static_eval(st);
 
 		if (st.move_iter == st.move_arr) {
-			I16 orig_eval = st.get_eval();
+			I16 orig_eval = static_eval(st);
 
 			std::visit(UpdateMoves(), stx);
 			if (st.move_iter == st.move_arr) {
-				if (st.in_check) return INT16_MIN + 1 + (start_depth + depth);
+				if (st.in_check) return INT16_MIN + ply;
 				else return 0;
 			}
 
 			return orig_eval;
 		}
 
-		if (depth <= 0) { return st.get_eval(); }
+		if (depth <= 0) { return static_eval(st); }
 
+		// Most quiescence nodes end on the stand pat, which is cheaper than a search table probe
+		I16 stand_pat_score = EVAL_NONE;
 		if (!st.in_check) {
-			I16 stand_pat_score = st.get_eval();
-			if (stand_pat_score >= beta) return beta;
-			if (stand_pat_score > alpha) alpha = stand_pat_score;
+			stand_pat_score = static_eval(st);
+			I16 corrected_stand_pat = corrected_eval(st, stand_pat_score);
+			if (corrected_stand_pat >= beta) return beta;
+			if (corrected_stand_pat > alpha) alpha = corrected_stand_pat;
 		}
 		
 		I16 score;
@@ -447,7 +883,7 @@ public:
 			if (score >= -alpha) score = alpha;
 			else {
 				std::visit(UpdateCaptures(), next_stx);
-				score = -quiescent(-beta, -alpha, depth - 1, next_stx);
+				score = -quiescent(-beta, -alpha, depth - 1, ply + 1, next_stx);
 			}
 		};
 
@@ -457,6 +893,7 @@ public:
 				node_type = HASH_EXACT;
 				best_score = score;
 				best_move_local = mv;
+				update_pv(ply, mv);
 			}
 			else if (score > best_score) {
 				best_score = score;
@@ -466,16 +903,17 @@ public:
 
 		auto set_zentry = [&](I16 score, U8 node_type, Move mv) {
 			zentry.setHash(st.zobrist_hash);
+			zentry.static_eval = stand_pat_score;
 			zentry.setTypeAndDepthAndQuis(node_type, depth);
 			zentry.best_move = mv;
-			zentry.score = score;
+			zentry.score = score_to_tt(score, ply);
 			zentry_og = zentry;
 		};
 
 		bool zobrist_hit = zentry.softEquals(st.zobrist_hash);
 		if (zobrist_hit) {
 			IF_DEBUG{ stats.zobrist_hits++; stats.total_qnodes++; }
-			I16 stored_score = evalScoreQuiescenceTPT(zentry, alpha, beta, 0);
+			I16 stored_score = evalScoreQuiescenceTPT(zentry, alpha, beta, 0, ply);
 			if (stored_score != INT16_MAX) { return stored_score; }
 		}
 
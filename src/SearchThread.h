@@ -0,0 +1,73 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/*
+	Search thread
+	Persistent worker the UCI loop hands its searches to, so stdin keeps being read while searching.
+	The thread sleeps on a condition variable between searches instead of being created for every search.
+*/
+
+class SearchThread {
+public:
+	SearchThread() : worker(&SearchThread::idle_loop, this) {}
+
+	~SearchThread() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			exiting = true;
+		}
+		cv.notify_all();
+		worker.join();
+	}
+
+	SearchThread(const SearchThread&) = delete;
+	SearchThread& operator=(const SearchThread&) = delete;
+
+	// Waits for the previous job, the caller has to stop it first if it can run forever
+	void start(std::function<void()> new_job) {
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [this] { return !searching; });
+		job = std::move(new_job);
+		searching = true;
+		lock.unlock();
+		cv.notify_all();
+	}
+
+	void wait() {
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [this] { return !searching; });
+	}
+
+	bool is_searching() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return searching;
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::function<void()> job;
+	bool searching = false;
+	bool exiting = false;
+	std::thread worker;
+
+	void idle_loop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			cv.wait(lock, [this] { return searching || exiting; });
+			if (exiting) return;
+
+			auto current_job = std::move(job);
+			lock.unlock();
+			current_job();
+			lock.lock();
+
+			searching = false;
+			cv.notify_all();
+		}
+	}
+};
@@ -134,7 +134,7 @@ U64 State::handle_sliding_checkers(U64 queen_checkers, U64 rook_checker, U64 bis
 	while (rook_checker != 0) {
 		U8 pieceIndex = bsf(rook_checker);
 		coverage |= this->data_table->queen_lines[pieceIndex].rook;
-		check_mask |= this->data_table->line_index[kingIndexMultiplied + pieceIndex].partial;
+		check_mask |= this->data_table->lines.partial[kingIndexMultiplied + pieceIndex];
 
 		rook_checker &= rook_checker - 1;
 	}
@@ -142,14 +142,14 @@ U64 State::handle_sliding_checkers(U64 queen_checkers, U64 rook_checker, U64 bis
 	if (bishop_checker != 0) {
 		U8 pieceIndex = bsf(bishop_checker);
 		coverage |= this->data_table->queen_lines[pieceIndex].bishop;
-		check_mask |= this->data_table->line_index[kingIndexMultiplied + pieceIndex].partial;
+		check_mask |= this->data_table->lines.partial[kingIndexMultiplied + pieceIndex];
 
 		bishop_checker &= bishop_checker - 1;
 	}
 
 	while (queen_checkers != 0) {
 		U8 pieceIndex = bsf(queen_checkers);
-		check_mask |= this->data_table->line_index[kingIndexMultiplied + pieceIndex].partial;
+		check_mask |= this->data_table->lines.partial[kingIndexMultiplied + pieceIndex];
 		coverage |= this->data_table->queen_lines[pieceIndex].bishop;
 		coverage |= this->get_rook_rays_custom(pieceIndex, this->piecesBB[ALL_PIECES_ID] ^ (1ULL << (kingIndexMultiplied >> 6)));
 		queen_checkers &= queen_checkers - 1;
@@ -165,6 +165,52 @@ void State::add_to_coverage(U64 pieces, U64 blocking_pieces, U64& coverage, U64(
 	}
 }
 
+void State::add_slider_coverage(U64 queens, U64 bishops, U64 rooks, U64& coverage) {
+	U64 all_pieces = this->piecesBB[ALL_PIECES_ID];
+	if constexpr (INCREMENTAL_SLIDER_ATTACKS) coverage |= this->cached_slider_coverage(queens | bishops | rooks, [&](U8 squareIndex) { return get_slider_attacks(squareIndex, all_pieces); });
+	else if constexpr (KOGGE_STONE_COVERAGE) coverage |= kogge_stone_coverage(queens | rooks, queens | bishops, all_pieces);
+	else {
+		add_to_coverage(queens, all_pieces, coverage, &State::get_moves_queen);
+		add_to_coverage(bishops, all_pieces, coverage, &State::get_moves_bishop);
+		add_to_coverage(rooks, all_pieces, coverage, &State::get_moves_rook);
+	}
+}
+
+/*
+	Incremental slider attacks
+	A move can only change the attacks of sliders on a line through a square that changed occupancy,
+	those and the slider landing on the destination square (including promotions and castling rooks) are marked stale.
+	Stale attacks are recomputed lazily once the coverage of their side is needed.
+*/
+
+U64 State::get_slider_attacks(U8 squareIndex, U64 all_pieces) {
+	U64 squareBB = 1ULL << squareIndex;
+	U64 queens = this->piecesBB[WHITE_QUEENS_ID] | this->piecesBB[BLACK_QUEENS_ID];
+	U64 attacks = 0ULL;
+	if (squareBB & (this->piecesBB[WHITE_ROOKS_ID] | this->piecesBB[BLACK_ROOKS_ID] | queens)) attacks |= this->get_moves_rook(squareIndex, all_pieces);
+	if (squareBB & (this->piecesBB[WHITE_BISHOPS_ID] | this->piecesBB[BLACK_BISHOPS_ID] | queens)) attacks |= this->get_moves_bishop(squareIndex, all_pieces);
+	return attacks;
+}
+
+void State::refresh_slider_attacks() {
+	U64 all_pieces = this->piecesBB[ALL_PIECES_ID];
+	this->refresh_cached_attacks(this->get_sliders(), [&](U8 squareIndex) { return get_slider_attacks(squareIndex, all_pieces); });
+}
+
+void State::update_slider_attacks(U64 changed_occupancy, U64 toPieceBB) {
+	U64 queens = this->piecesBB[WHITE_QUEENS_ID] | this->piecesBB[BLACK_QUEENS_ID];
+	U64 rook_sliders = this->piecesBB[WHITE_ROOKS_ID] | this->piecesBB[BLACK_ROOKS_ID] | queens;
+	U64 bishop_sliders = this->piecesBB[WHITE_BISHOPS_ID] | this->piecesBB[BLACK_BISHOPS_ID] | queens;
+
+	U64 stale = (rook_sliders | bishop_sliders) & (changed_occupancy | toPieceBB);
+	while (changed_occupancy != 0) {
+		const QueenLine& lines = this->data_table->queen_lines[bsf(changed_occupancy)];
+		stale |= (rook_sliders & lines.rook) | (bishop_sliders & lines.bishop);
+		changed_occupancy &= changed_occupancy - 1;
+	}
+	this->mark_stale(stale);
+}
+
 constexpr U64 State::get_pinned_line(U64 squareIndex) {
 	return ALL_LINES[this->pinnedPieceBB[squareIndex]];
 }
@@ -178,7 +224,7 @@ inline void State::handle_enpassent_pin(U64 pawns, U64 king, U64 coverage, U64 r
 			U64 enp_mask = ((7ULL << (enp_pawn_index - 1)) & pawns) | (1ULL << enp_pawn_index);
 			U64 tricky_pins = ((coverage | rook_rays) & enp_mask);
 			tricky_pins *= ((tricky_pins >> 2) & tricky_pins) == 0;
-			this->enpassent_square *= __popcnt64(tricky_pins) != 2;
+			this->enpassent_square *= popcnt(tricky_pins) != 2;
 		}
 	}
 }
@@ -235,7 +281,7 @@ U64 State::handle_pinning_and_checks(U64 rook_pinning, U64 bishop_pinning, U64 q
 
 	while (pinned_pieces != 0) {
 		U8 pieceIndex = bsf(pinned_pieces);
-		this->pinnedPieceBB[pieceIndex] = this->data_table->line_index[kingIndexMultiplied + pieceIndex].line_index;
+		this->pinnedPieceBB[pieceIndex] = this->data_table->lines.index[kingIndexMultiplied + pieceIndex];
 		pinned_pieces &= pinned_pieces - 1;
 	}
 
@@ -246,8 +292,6 @@ U64 State::handle_pinning_and_checks(U64 rook_pinning, U64 bishop_pinning, U64 q
 std::tuple<U64, U64, U64> State::update_covered_squares() {
 	U64 enemy_king = this->piecesBB[WHITE_KING_ID + this->turn];
 
-	U64 all_pieces = this->piecesBB[ALL_PIECES_ID];
-
 	U64 king = this->piecesBB[WHITE_KING_ID + !this->turn];
 	U64 coverage = this->get_moves_king(bsf(king), 0ULL);
 
@@ -266,28 +310,15 @@ std::tuple<U64, U64, U64> State::update_covered_squares() {
 	U64 queen_pinning = enemy_king_lines.queen & queens;
 	queens ^= queen_pinning;
 
-	while (queens != 0) {
-		coverage |= this->get_moves_queen(bsf(queens), all_pieces);
-		queens &= queens - 1;
-	}
-
 	U64 bishops = this->piecesBB[WHITE_BISHOPS_ID + !this->turn];
 	U64 bishops_pinning = enemy_king_lines.bishop & (bishops | queen_pinning);
 	bishops &= ~bishops_pinning;
 
-	while (bishops != 0) {
-		coverage |= this->get_moves_bishop(bsf(bishops), all_pieces);
-		bishops &= bishops - 1;
-	}
-
 	U64 rooks = this->piecesBB[WHITE_ROOKS_ID + !this->turn];
 	U64 rooks_pinning = enemy_king_lines.rook & (rooks | queen_pinning);
 	rooks &= ~rooks_pinning;
 
-	while (rooks != 0) {
-		coverage |= this->get_moves_rook(bsf(rooks), all_pieces);
-		rooks &= rooks - 1;
-	}
+	add_slider_coverage(queens, bishops, rooks, coverage);
 	
 	U64 check_mask = 0ULL;
 	if (rooks_pinning | bishops_pinning | queen_pinning) check_mask |= handle_pinning_and_checks(rooks_pinning, bishops_pinning, queen_pinning, enemy_king_index, coverage, checkers);
@@ -313,31 +344,130 @@ std::tuple<U64, U64, U64> State::update_covered_squares() {
 }
 
 /*
-	Move and capture generator used in pseudo-legal generation process
+	Lazy evaluation stage
+	Mobility, threats and king safety of the side to move, only computed once the position is evaluated.
+	Reads the pins and the mobility area left by update_covered_squares, so it needs the covered squares of the position.
 */
 
+// A king on its back rank reads its shelter from the pawn hash entry, elsewhere it is computed from the pawns
 void State::update_wking_pawn_eval(U8 kingIndex) {
-	U64 wpawns = this->piecesBB[WHITE_PAWNS_ID];
-	U64 bpawns = this->piecesBB[BLACK_PAWNS_ID];
-
-	KingPawns wking_pawns = this->data_table->wking_pawns[kingIndex];
-	I16 eval = (I16)popcnt(wking_pawns.pawn_shield & wpawns) * 8;
-	eval += (I16)popcnt((wking_pawns.pawn_shield << 8) & wpawns) * 6;
-	eval -= (I16)popcnt(wking_pawns.pawn_storm & bpawns) * 8;
-	this->mg_eval.extra_eval += eval;
+	I16 eval;
+	if (kingIndex < 8) eval = get_pawn_entry().king_shelter[WHITE][kingIndex];
+	else eval = wking_shelter(this->data_table->wking_pawns[kingIndex], this->piecesBB[WHITE_PAWNS_ID], this->piecesBB[BLACK_PAWNS_ID]);
+	this->packed_eval.extra_eval += make_score(eval, 0);
 }
 
 void State::update_bking_pawn_eval(U8 kingIndex) {
-	U64 wpawns = this->piecesBB[WHITE_PAWNS_ID];
-	U64 bpawns = this->piecesBB[BLACK_PAWNS_ID];
+	I16 eval;
+	if (kingIndex >= 56) eval = get_pawn_entry().king_shelter[BLACK][kingIndex & 7];
+	else eval = bking_shelter(this->data_table->bking_pawns[kingIndex], this->piecesBB[WHITE_PAWNS_ID], this->piecesBB[BLACK_PAWNS_ID]);
+	this->packed_eval.extra_eval += make_score(eval, 0);
+}
+
+void State::eval_mobility() {
+	U64 all_pieces = this->piecesBB[ALL_PIECES_ID];
+	U64 area = this->mobility_area & ~this->piecesBB[WHITE_PIECES_ID + this->turn];
+	U64 enemy_king_zone = this->data_table->get_king_move(bsf(this->piecesBB[BLACK_KING_ID - this->turn]));
+	U64 minor_attacks = 0ULL, rook_attacks = 0ULL, queen_attacks = 0ULL;
+	U8 king_attackers = 0;
+	I16 king_attack_weight = 0;
+	Score score = 0;
+
+	// Counts the piece towards the attack on the enemy king and returns its mobility
+	auto add_piece = [&](U8 pieceID, U64 attacks) {
+		U64 zone_attacks = attacks & enemy_king_zone;
+		if (zone_attacks) {
+			king_attackers++;
+			king_attack_weight += king_attack_weights[pieceID] * (I16)popcnt(zone_attacks);
+		}
+		return popcnt(attacks & area);
+	};
+
+	U64 knights = this->piecesBB[WHITE_KNIGHTS_ID + this->turn];
+	while (knights != 0) {
+		U8 pieceIndex = bsf(knights);
+		U64 attacks = this->data_table->get_knight_move(pieceIndex) & this->get_pinned_line(pieceIndex);
+		minor_attacks |= attacks;
+		score += knight_mobility[add_piece(WHITE_KNIGHTS_ID, attacks)];
+		knights &= knights - 1;
+	}
+
+	U64 bishops = this->piecesBB[WHITE_BISHOPS_ID + this->turn];
+	while (bishops != 0) {
+		U8 pieceIndex = bsf(bishops);
+		U64 attacks = this->data_table->get_bishop_move(pieceIndex, all_pieces) & this->get_pinned_line(pieceIndex);
+		minor_attacks |= attacks;
+		score += bishop_mobility[add_piece(WHITE_BISHOPS_ID, attacks)];
+		bishops &= bishops - 1;
+	}
 
-	KingPawns bking_pawns = this->data_table->bking_pawns[kingIndex];
-	I16 eval = (I16)popcnt(bking_pawns.pawn_shield & bpawns) * 8;
-	eval += (I16)popcnt((bking_pawns.pawn_shield >> 8) & bpawns) * 6;
-	eval -= (I16)popcnt(bking_pawns.pawn_storm & wpawns) * 8;
-	this->mg_eval.extra_eval += eval;
+	U64 rooks = this->piecesBB[WHITE_ROOKS_ID + this->turn];
+	while (rooks != 0) {
+		U8 pieceIndex = bsf(rooks);
+		U64 attacks = this->data_table->get_rook_move(pieceIndex, all_pieces) & this->get_pinned_line(pieceIndex);
+		rook_attacks |= attacks;
+		score += rook_mobility[add_piece(WHITE_ROOKS_ID, attacks)];
+		rooks &= rooks - 1;
+	}
+
+	U64 queens = this->piecesBB[WHITE_QUEENS_ID + this->turn];
+	while (queens != 0) {
+		U8 pieceIndex = bsf(queens);
+		U64 attacks = this->data_table->get_queen_move(pieceIndex, all_pieces) & this->get_pinned_line(pieceIndex);
+		queen_attacks |= attacks;
+		score += queen_mobility[add_piece(WHITE_QUEENS_ID, attacks)];
+		queens &= queens - 1;
+	}
+
+	U8 kingIndex = bsf(this->piecesBB[WHITE_KING_ID + this->turn]);
+	U64 pawns = this->piecesBB[WHITE_PAWNS_ID + this->turn];
+	U64 pawn_attacks = this->turn ? ((pawns >> 9) & NOT_FILE_H) | ((pawns >> 7) & NOT_FILE_A) : ((pawns << 7) & NOT_FILE_H) | ((pawns << 9) & NOT_FILE_A);
+	U64 attacks = minor_attacks | rook_attacks | queen_attacks | pawn_attacks | this->data_table->get_king_move(kingIndex);
+	score += eval_threats(pawn_attacks, minor_attacks, rook_attacks, attacks);
+
+	// Only the union of the enemy attacks is known, so our king zone counts attacked squares instead of attackers
+	I16 king_safety = (I16)get_king_zone_pressure() * king_zone_pressure;
+	king_safety += (king_attack_weight * king_attack_scale[std::min(king_attackers, (U8)7)]) >> 2;
+	this->packed_eval.extra_eval += score + make_score(king_safety, 0);
+
+	if (this->turn) update_bking_pawn_eval(kingIndex);
+	else update_wking_pawn_eval(kingIndex);
+
+	this->mobility_evaluated = true;
 }
 
+// Threats between the pieces, the enemy defends every square it covers
+Score State::eval_threats(U64 pawn_attacks, U64 minor_attacks, U64 rook_attacks, U64 attacks) {
+	U8 enemy = this->turn ^ 1;
+	U64 own_pieces = this->piecesBB[WHITE_PIECES_ID + this->turn] & ~this->piecesBB[WHITE_PAWNS_ID + this->turn] & ~this->piecesBB[WHITE_KING_ID + this->turn];
+	U64 enemy_pieces = this->piecesBB[WHITE_PIECES_ID + enemy] & ~this->piecesBB[WHITE_PAWNS_ID + enemy] & ~this->piecesBB[WHITE_KING_ID + enemy];
+	U64 enemy_majors = this->piecesBB[WHITE_ROOKS_ID + enemy] | this->piecesBB[WHITE_QUEENS_ID + enemy];
+
+	Score score = threat_by_pawn * (I32)popcnt(pawn_attacks & enemy_pieces);
+	score += threat_by_minor * (I32)popcnt(minor_attacks & enemy_majors);
+	score += threat_by_rook * (I32)popcnt(rook_attacks & this->piecesBB[WHITE_QUEENS_ID + enemy]);
+	score += hanging_piece * (I32)popcnt(attacks & enemy_pieces & ~this->enemy_attacks);
+
+	score += threatened_by_pawn * (I32)popcnt(get_pawn_threats());
+	score += hanging_own_piece * (I32)popcnt(own_pieces & this->enemy_attacks & ~attacks);
+	return score;
+}
+
+// Pieces of the side to move attacked by enemy pawns, only needs the covered squares of the position
+U64 State::get_pawn_threats() {
+	U64 own_pieces = this->piecesBB[WHITE_PIECES_ID + this->turn] & ~this->piecesBB[WHITE_PAWNS_ID + this->turn] & ~this->piecesBB[WHITE_KING_ID + this->turn];
+	return own_pieces & ~this->mobility_area;
+}
+
+// Squares next to the king of the side to move attacked by the enemy, only needs the covered squares of the position
+U8 State::get_king_zone_pressure() {
+	return (U8)popcnt(this->enemy_attacks & this->data_table->get_king_move(bsf(this->piecesBB[WHITE_KING_ID + this->turn])));
+}
+
+/*
+	Move and capture generator used in pseudo-legal generation process
+*/
+
 U64 State::update_moves_wking(U8 squareIndex, U64 own_pieces, U64 coverage) {
 	U64 moves = this->data_table->get_king_move(squareIndex) & ~own_pieces;
 	U64 all_pieces = this->piecesBB[ALL_PIECES_ID];
@@ -351,7 +481,6 @@ U64 State::update_moves_wking(U8 squareIndex, U64 own_pieces, U64 coverage) {
 	U64 rollout_setup = all_pieces | (coverage & WHITE_CASTLE_IGNORE);
 	moves |= (((rollout_setup & WHITE_LEFT_CASTLE_PATH) == 0) & wlong) * WHITE_LEFT_CASTLE_MOVE;
 	moves |= (((rollout_setup & WHITE_RIGHT_CASTLE_PATH) == 0) & wshort) * WHITE_RIGHT_CASTLE_MOVE;
-	update_wking_pawn_eval(squareIndex);
 
 	return moves & ~coverage;
 }
@@ -369,67 +498,31 @@ U64 State::update_moves_bking(U8 squareIndex, U64 own_pieces, U64 coverage) {
 	U64 rollout_setup = all_pieces | (coverage & BLACK_CASTLE_IGNORE);
 	moves |= (((rollout_setup & BLACK_LEFT_CASTLE_PATH) == 0) & blong) * BLACK_LEFT_CASTLE_MOVE;
 	moves |= (((rollout_setup & BLACK_RIGHT_CASTLE_PATH) == 0) & bshort) * BLACK_RIGHT_CASTLE_MOVE;
-	update_bking_pawn_eval(squareIndex);
 
 	return moves & ~coverage;
 }
 
 U64 State::update_moves_wking_checked(U8 squareIndex, U64 own_pieces, U64 coverage) {
 	U64 rooks = this->piecesBB[WHITE_ROOKS_ID];
-	U8 allowed_king = (U8)_rotl64(0x1000000000000000, squareIndex);
+	U8 allowed_king = (U8)rotl64(0x1000000000000000, squareIndex);
 	this->events.update_wshort(allowed_king & (rooks >> 7) & 1);
 	this->events.update_wlong(allowed_king & rooks & 1);
-	update_wking_pawn_eval(squareIndex);
 
 	return this->data_table->get_king_move(squareIndex) & ~(own_pieces | coverage);
 }
 
 U64 State::update_moves_bking_checked(U8 squareIndex, U64 own_pieces, U64 coverage) {
 	U64 rooks = this->piecesBB[BLACK_ROOKS_ID];
-	U8 allowed_king = (U8)_rotl64(0x4, squareIndex);
+	U8 allowed_king = (U8)rotl64(0x4, squareIndex);
 	this->events.update_bshort(allowed_king & (rooks >> 63) & 1);
 	this->events.update_blong(allowed_king & (rooks >> 56) & 1);
-	update_bking_pawn_eval(squareIndex);
 
 	return this->data_table->get_king_move(squareIndex) & ~(own_pieces | coverage);
 }
 
 U64 State::update_moves_knight(U8 squareIndex, U64 own_pieces) {
 	U64 moves = this->data_table->get_knight_move(squareIndex) & ~own_pieces;
-	U64 legal_moves = moves & this->get_pinned_line(squareIndex);
-	this->mg_eval.extra_eval += knight_mobility_scores[popcnt(legal_moves & this->enpassent_square)];
-	this->eg_eval.extra_eval += knight_mobility_scores_eg[popcnt(legal_moves & this->enpassent_square)];
-	return legal_moves;
-}
-
-inline void State::insert_pawn_moves(U64 moves, I8 offset, Move*& mv) {
-	while (moves != 0) {
-		U8 attackIndex = bsf(moves);
-		*(mv++) = Move(attackIndex + offset, attackIndex);
-		moves &= moves - 1;
-	}
-}
-
-inline void State::insert_white_promo_moves(U64 moves, U8 squareIndex, Move*& mv) {
-	while (moves != 0) {
-		U8 targetIndex = bsf(moves);
-		*(mv++) = Move(squareIndex, targetIndex, WHITE_QUEENS_ID);
-		*(mv++) = Move(squareIndex, targetIndex, WHITE_ROOKS_ID);
-		*(mv++) = Move(squareIndex, targetIndex, WHITE_BISHOPS_ID);
-		*(mv++) = Move(squareIndex, targetIndex, WHITE_KNIGHTS_ID);
-		moves &= moves - 1;
-	}
-}
-
-inline void State::insert_black_promo_moves(U64 moves, U8 squareIndex, Move*& mv) {
-	while (moves != 0) {
-		U8 targetIndex = bsf(moves);
-		*(mv++) = Move(squareIndex, targetIndex, BLACK_QUEENS_ID);
-		*(mv++) = Move(squareIndex, targetIndex, BLACK_ROOKS_ID);
-		*(mv++) = Move(squareIndex, targetIndex, BLACK_BISHOPS_ID);
-		*(mv++) = Move(squareIndex, targetIndex, BLACK_KNIGHTS_ID);
-		moves &= moves - 1;
-	}
+	return moves & this->get_pinned_line(squareIndex);
 }
 
 template<PawnTypes T, PawnTypes U, PawnTypes V>
@@ -456,7 +549,7 @@ void State::insert_bpawn_template(U64 pinned_wpawns, U64 empty_squares, U64 capt
 	while (pinned_wpawns != 0) {
 		U8 pawn_index = bsf(pinned_wpawns);
 
-		U64 moves = _rotl64(BIT56, pawn_index) & empty_squares;
+		U64 moves = rotl64(BIT56, pawn_index) & empty_squares;
 		if constexpr (!IS_PROMO) moves |= moves >> 8 & RANK_5 & empty_squares;
 		moves |= this->data_table->get_bpawn_move(pawn_index) & captures;
 
@@ -549,76 +642,57 @@ Move* State::update_bpawns(U64 pawns, U64 check_mask, Move* mv) {
 
 U64 State::update_moves_rook(U8 squareIndex, U64 own_pieces) {
 	U64 moves = this->data_table->get_rook_move(squareIndex, this->piecesBB[ALL_PIECES_ID]) & ~own_pieces;
-	U64 legal_moves = moves & this->get_pinned_line(squareIndex);
-	this->mg_eval.extra_eval += rook_mobility_scores[popcnt(legal_moves & this->zobrist_hash)];
-	this->eg_eval.extra_eval += rook_mobility_scores_eg[popcnt(legal_moves & this->zobrist_hash)];
-	return legal_moves;
+	return moves & this->get_pinned_line(squareIndex);
 }
 
 U64 State::update_moves_bishop(U8 squareIndex, U64 own_pieces) {
 	U64 moves = this->data_table->get_bishop_move(squareIndex, this->piecesBB[ALL_PIECES_ID]) & ~own_pieces;
-	U64 legal_moves = moves & this->get_pinned_line(squareIndex);
-	this->mg_eval.extra_eval += bishop_mobility_scores[popcnt(legal_moves & this->zobrist_hash)];
-	this->eg_eval.extra_eval += bishop_mobility_scores_eg[popcnt(legal_moves & this->zobrist_hash)];
-	return legal_moves;
+	return moves & this->get_pinned_line(squareIndex);
 }
 
 U64 State::update_moves_queen(U8 squareIndex, U64 own_pieces) {
 	U64 moves = this->data_table->get_queen_move(squareIndex, this->piecesBB[ALL_PIECES_ID]) & ~own_pieces;
-	U64 legal_moves = moves & this->get_pinned_line(squareIndex);
-	this->mg_eval.extra_eval += queen_mobility_scores[popcnt(legal_moves & this->zobrist_hash)];
-	this->eg_eval.extra_eval += queen_mobility_scores_eg[popcnt(legal_moves & this->zobrist_hash)];
-	return legal_moves;
+	return moves & this->get_pinned_line(squareIndex);
 }
 
 U64 State::get_captures_rook(U8 squareIndex, U64 enemy_pieces) {
 	U64 all_pieces = this->piecesBB[ALL_PIECES_ID];
 	U64 moves = this->data_table->get_rook_move(squareIndex, all_pieces) & this->get_pinned_line(squareIndex);
-	this->mg_eval.extra_eval += rook_mobility_scores[popcnt(moves & this->zobrist_hash)];
-	this->eg_eval.extra_eval += rook_mobility_scores_eg[popcnt(moves & this->zobrist_hash)];
 	return moves & enemy_pieces;
 }
 
 U64 State::get_captures_bishop(U8 squareIndex, U64 enemy_pieces) {
 	U64 all_pieces = this->piecesBB[ALL_PIECES_ID];
 	U64 moves = this->data_table->get_bishop_move(squareIndex, all_pieces) & this->get_pinned_line(squareIndex);
-	this->mg_eval.extra_eval += bishop_mobility_scores[popcnt(moves & this->zobrist_hash)];
-	this->eg_eval.extra_eval += bishop_mobility_scores_eg[popcnt(moves & this->zobrist_hash)];
 	return moves & enemy_pieces;
 }
 
 U64 State::get_captures_queen(U8 squareIndex, U64 enemy_pieces) {
 	U64 all_pieces = this->piecesBB[ALL_PIECES_ID];
 	U64 moves = this->data_table->get_queen_move(squareIndex, all_pieces) & this->get_pinned_line(squareIndex);
-	this->mg_eval.extra_eval += queen_mobility_scores[popcnt(moves & this->zobrist_hash)];
-	this->eg_eval.extra_eval += queen_mobility_scores_eg[popcnt(moves & this->zobrist_hash)];
 	return moves & enemy_pieces;
 }
 
 U64 State::get_captures_wking(U8 squareIndex, U64 enemy_pieces, U64 coverage) {
 	U64 rooks = this->piecesBB[WHITE_ROOKS_ID];
-	U8 allowed_king = (U8)_rotl64(0x1000000000000000, squareIndex);
+	U8 allowed_king = (U8)rotl64(0x1000000000000000, squareIndex);
 	this->events.update_wshort(allowed_king & (rooks >> 7) & 1);
 	this->events.update_wlong(allowed_king & rooks & 1);
-	update_wking_pawn_eval(squareIndex);
 
 	return this->data_table->get_king_move(squareIndex) & enemy_pieces & ~coverage;
 }
 
 U64 State::get_captures_bking(U8 squareIndex, U64 enemy_pieces, U64 coverage) {
 	U64 rooks = this->piecesBB[BLACK_ROOKS_ID];
-	U8 allowed_king = (U8)_rotl64(0x4, squareIndex);
+	U8 allowed_king = (U8)rotl64(0x4, squareIndex);
 	this->events.update_bshort(allowed_king & (rooks >> 63) & 1);
 	this->events.update_blong(allowed_king & (rooks >> 56) & 1);
-	update_bking_pawn_eval(squareIndex);
 
 	return this->data_table->get_king_move(squareIndex) & enemy_pieces & ~coverage;
 }
 
 U64 State::get_captures_knight(U8 squareIndex, U64 enemy_pieces) {
 	U64 moves = this->data_table->get_knight_move(squareIndex) & this->get_pinned_line(squareIndex);
-	this->mg_eval.extra_eval += knight_mobility_scores[popcnt(moves & this->zobrist_hash)];
-	this->eg_eval.extra_eval += knight_mobility_scores_eg[popcnt(moves & this->zobrist_hash)];
 	return moves & enemy_pieces;
 }
 
@@ -631,3 +705,20 @@ U64 State::get_moves_queen(U8 squareIndex, U64 all_pieces) { return this->data_t
 U64 State::get_rook_rays_custom(U64 squareIndex, U64 pieces) { return this->data_table->get_rook_move(squareIndex, pieces); }
 U64 State::get_bishop_rays_custom(U64 squareIndex, U64 pieces) { return this->data_table->get_bishop_move(squareIndex, pieces); }
 
+/*
+	Explicit instantiations of the pawn move generators, used by StateWhite, StateBlack and the pawn captures in State.h
+*/
+
+template Move* State::update_wpawns<PawnTypes::None>(U64, U64, Move*);
+template Move* State::update_wpawns<PawnTypes::Checked>(U64, U64, Move*);
+template Move* State::update_bpawns<PawnTypes::None>(U64, U64, Move*);
+template Move* State::update_bpawns<PawnTypes::Checked>(U64, U64, Move*);
+
+#define INSTANTIATE_PINNED_PAWN_MOVES(U, V) \
+	template void State::insert_wpawn_template<PawnTypes::Pinned, U, V>(U64, U64, U64, U64, Move*&); \
+	template void State::insert_bpawn_template<PawnTypes::Pinned, U, V>(U64, U64, U64, U64, Move*&);
+
+INSTANTIATE_PINNED_PAWN_MOVES(PawnTypes::None, PawnTypes::None)
+INSTANTIATE_PINNED_PAWN_MOVES(PawnTypes::None, PawnTypes::Promo)
+INSTANTIATE_PINNED_PAWN_MOVES(PawnTypes::Checked, PawnTypes::None)
+INSTANTIATE_PINNED_PAWN_MOVES(PawnTypes::Checked, PawnTypes::Promo)
@@ -6,6 +6,7 @@
 #include "DataGenerator.h"
 #include "ChessConstants.h"
 #include "DataTable.h"
+#include "KoggeStone.h"
 
 constexpr U64 BIT9 = 0x100;
 constexpr U64 BIT56 = 0x100000000000000;
@@ -95,8 +96,8 @@ enum class PawnTypes {
 };
 
 struct EvalPackage {
-	I16 base_eval;
-	I16 extra_eval = 0;
+	Score base_eval;
+	Score extra_eval = 0;
 
 	EvalPackage() : base_eval(0) {}
 	EvalPackage(EvalPackage& oth) : base_eval(oth.base_eval) {}
@@ -106,6 +107,97 @@ struct EvalPackage {
 #define IS_CHECKED (U == PawnTypes::Checked)
 #define IS_PROMO (V == PawnTypes::Promo)
 
+/*
+	Move generator policy
+	Selects at compile time which side work the move generator performs next to generating moves.
+	The engine uses the full variant, perft and other pure move generation consumers can strip
+	the evaluation (PSQT and the mobility area) and zobrist hashing work entirely.
+*/
+
+struct MoveGenPolicy {
+	bool eval;
+	bool hash;
+};
+
+constexpr MoveGenPolicy FULL_GEN = { true, true };
+constexpr MoveGenPolicy HASH_GEN = { false, true };
+constexpr MoveGenPolicy PURE_GEN = { false, false };
+
+#define GEN_EVAL (P.eval)
+#define GEN_HASH (P.hash)
+
+/*
+	Incremental slider attacks
+	Keeps the attack sets of all sliders between moves and only recomputes those a move can affect.
+	Carrying the cache into every child state costs about as much as the PEXT lookups it saves on
+	hardware with a fast PEXT, so it is disabled by default. It pays off where slider lookups are slow.
+*/
+
+constexpr bool INCREMENTAL_SLIDER_ATTACKS = false;
+
+// Attack sets of every slider on the board indexed by square, stale entries are recomputed when they are needed
+template<bool Incremental>
+struct SliderAttackCache {
+	std::array<U64, 64> slider_attacks;
+	U64 stale_sliders = 0ULL;
+
+	SliderAttackCache() = default;
+
+	// Only the up to date slider entries are valid, copying those is cheaper than the full array
+	SliderAttackCache(const SliderAttackCache& s, U64 sliders) : stale_sliders(s.stale_sliders) {
+		sliders &= ~s.stale_sliders;
+		while (sliders != 0) {
+			U8 pieceIndex = bsf(sliders);
+			this->slider_attacks[pieceIndex] = s.slider_attacks[pieceIndex];
+			sliders &= sliders - 1;
+		}
+	}
+
+	template<typename F>
+	void refresh_cached_attacks(U64 sliders, F get_attacks) {
+		this->stale_sliders = 0ULL;
+		while (sliders != 0) {
+			U8 pieceIndex = bsf(sliders);
+			this->slider_attacks[pieceIndex] = get_attacks(pieceIndex);
+			sliders &= sliders - 1;
+		}
+	}
+
+	template<typename F>
+	U64 cached_slider_coverage(U64 sliders, F get_attacks) {
+		U64 stale = sliders & this->stale_sliders;
+		this->stale_sliders ^= stale;
+		while (stale != 0) {
+			U8 pieceIndex = bsf(stale);
+			this->slider_attacks[pieceIndex] = get_attacks(pieceIndex);
+			stale &= stale - 1;
+		}
+
+		U64 coverage = 0ULL;
+		while (sliders != 0) {
+			coverage |= this->slider_attacks[bsf(sliders)];
+			sliders &= sliders - 1;
+		}
+		return coverage;
+	}
+
+	void mark_stale(U64 sliders) { this->stale_sliders |= sliders; }
+};
+
+// Without incremental slider attacks the cache is an empty base, so states carry and copy none of it
+template<>
+struct SliderAttackCache<false> {
+	SliderAttackCache() = default;
+	SliderAttackCache(const SliderAttackCache&, U64) {}
+
+	template<typename F> void refresh_cached_attacks(U64, F) {}
+	template<typename F> U64 cached_slider_coverage(U64, F) { return 0ULL; }
+	void mark_stale(U64) {}
+};
+
+// Computes the coverage of all sliders of a side with an AVX2 Kogge-Stone fill instead of per piece PEXT lookups
+constexpr bool KOGGE_STONE_COVERAGE = false;
+
 /*
 	 Snapshot of all data at an arbitrary moment in time
 	 Utilizes mostly branchless code.
@@ -114,7 +206,7 @@ struct EvalPackage {
 	 This is for effiency reasons, and comes at the cost of readability.
 */
 
-class State {
+class State : public SliderAttackCache<INCREMENTAL_SLIDER_ATTACKS> {
 public:
 	// Bitboard data
 	std::array<U8, 64> pinnedPieceBB = {};
@@ -135,9 +227,18 @@ public:
 	Move* move_iter = move_arr;
 
 	U16 total_material = 0;
+	U64 material_key = 0ULL;
+
+	EvalPackage packed_eval;
 
-	EvalPackage mg_eval;
-	EvalPackage eg_eval;
+	// Squares not attacked by enemy pawns and all squares attacked by the enemy, set with the covered squares
+	// and read by the lazy evaluation stage and the search
+	U64 mobility_area = 0ULL;
+	U64 enemy_attacks = 0ULL;
+	bool mobility_evaluated = false;
+
+	// Only kept up to date while the NNUE evaluation is in use
+	NNUEAccumulator nnue_acc;
 
 	bool in_check = false;
 	bool null_move = false;
@@ -147,6 +248,7 @@ public:
 	State(DataTable* mtable) { construct_startpos(mtable); }
 
 	State(State& s) :
+		SliderAttackCache(s, s.get_sliders()),
 		piecesBB(s.piecesBB),
 		squareOcc(s.squareOcc),
 		//past_moves(s.past_moves),
@@ -159,11 +261,13 @@ public:
 		enpassent_square(s.enpassent_square),
 
 		total_material(s.total_material),
-		mg_eval(s.mg_eval),
-		eg_eval(s.eg_eval),	
+		material_key(s.material_key),
+		packed_eval(s.packed_eval),
 
 		turn(s.turn ^ 1)
-	{}
+	{
+		if (s.data_table->use_nnue) this->nnue_acc = s.nnue_acc;
+	}
 
 	/*
 		Bitboard related functions
@@ -174,9 +278,24 @@ public:
 	void construct_startpos(DataTable* mtable);
 
 	I16 get_eval();
-	I16 get_pawn_structure_eval();
+	I16 get_board_eval();
+	I16 get_tapered_eval(I32 phase);
+	void eval_mobility();
+	Score eval_threats(U64 pawn_attacks, U64 minor_attacks, U64 rook_attacks, U64 attacks);
+	U64 get_pawn_threats();
+	U8 get_king_zone_pressure();
+	PTableEntry& get_pawn_entry();
+	void eval_pawn_structure(PTableEntry& pEntry);
+	MTableEntry& get_material_entry();
+	void eval_material(MTableEntry& mEntry);
+	I16 eval_endgame();
+	I16 eval_kxk(U8 strong_side);
+	I16 eval_kbnk(U8 strong_side);
+	bool is_material_draw();
 	void update_move_eval(U8, U8, U8, U8, I16);
 	void full_eval();
+	void refresh_accumulator();
+	void update_move_nnue(U8 fromIndex, U8 toIndex, U8 fromPieceID, U8 toPieceID, U8 move_index);
 
 	void deriveSquareOcc();
 	void derivePiecesBB();
@@ -192,15 +311,15 @@ public:
 
 	void moveWhitePiece(U64, U64);
 	U64 moveWhitePawnsDouble(U64, U64, U8, U8);
-	U64 moveWhitePawnsEnpassent(U64, U64, U8, U8);
-	U64 moveWhitePawnsPromo(U64 fromPieceBB, U64 toPieceBB, U8 promoID, U8 toIndex);
-	U64 moveWhiteKingCastle(U64, U64, U8, U8);
+	template<MoveGenPolicy P> U64 moveWhitePawnsEnpassent(U64, U64, U8, U8);
+	template<MoveGenPolicy P> U64 moveWhitePawnsPromo(U64 fromPieceBB, U64 toPieceBB, U8 promoID, U8 toIndex);
+	template<MoveGenPolicy P> U64 moveWhiteKingCastle(U64, U64, U8, U8);
 	
 	void moveBlackPiece(U64, U64);
 	U64 moveBlackPawnsDouble(U64, U64, U8, U8);
-	U64 moveBlackPawnsEnpassent(U64, U64, U8, U8);
-	U64 moveBlackPawnsPromo(U64, U64, U8, U8);
-	U64 moveBlackKingCastle(U64, U64, U8, U8);
+	template<MoveGenPolicy P> U64 moveBlackPawnsEnpassent(U64, U64, U8, U8);
+	template<MoveGenPolicy P> U64 moveBlackPawnsPromo(U64, U64, U8, U8);
+	template<MoveGenPolicy P> U64 moveBlackKingCastle(U64, U64, U8, U8);
 
 
 	/*
@@ -223,6 +342,13 @@ public:
 
 	std::tuple<U64, U64, U64> update_covered_squares();
 	void add_to_coverage(U64, U64, U64&, U64(State::*get_moves_func)(U8, U64));
+	void add_slider_coverage(U64 queens, U64 bishops, U64 rooks, U64& coverage);
+	constexpr U64 get_sliders() {
+		return this->piecesBB[WHITE_ROOKS_ID] | this->piecesBB[BLACK_ROOKS_ID] | this->piecesBB[WHITE_BISHOPS_ID] | this->piecesBB[BLACK_BISHOPS_ID] | this->piecesBB[WHITE_QUEENS_ID] | this->piecesBB[BLACK_QUEENS_ID];
+	}
+	U64 get_slider_attacks(U8 squareIndex, U64 all_pieces);
+	void refresh_slider_attacks();
+	void update_slider_attacks(U64 changed_occupancy, U64 toPieceBB);
 	void handle_enpassent_pin(U64 pawns, U64 king, U64 coverage, U64 rook_rays);
 
 	void extract_moves(U64 moves, U8 squareIndex, Move*& mv);
@@ -339,6 +465,37 @@ public:
 
 };
 
+// Defined here as they are also used by the pawn captures above, which are compiled in every translation unit
+inline void State::insert_pawn_moves(U64 moves, I8 offset, Move*& mv) {
+	while (moves != 0) {
+		U8 attackIndex = bsf(moves);
+		*(mv++) = Move(attackIndex + offset, attackIndex);
+		moves &= moves - 1;
+	}
+}
+
+inline void State::insert_white_promo_moves(U64 moves, U8 squareIndex, Move*& mv) {
+	while (moves != 0) {
+		U8 targetIndex = bsf(moves);
+		*(mv++) = Move(squareIndex, targetIndex, WHITE_QUEENS_ID);
+		*(mv++) = Move(squareIndex, targetIndex, WHITE_ROOKS_ID);
+		*(mv++) = Move(squareIndex, targetIndex, WHITE_BISHOPS_ID);
+		*(mv++) = Move(squareIndex, targetIndex, WHITE_KNIGHTS_ID);
+		moves &= moves - 1;
+	}
+}
+
+inline void State::insert_black_promo_moves(U64 moves, U8 squareIndex, Move*& mv) {
+	while (moves != 0) {
+		U8 targetIndex = bsf(moves);
+		*(mv++) = Move(squareIndex, targetIndex, BLACK_QUEENS_ID);
+		*(mv++) = Move(squareIndex, targetIndex, BLACK_ROOKS_ID);
+		*(mv++) = Move(squareIndex, targetIndex, BLACK_BISHOPS_ID);
+		*(mv++) = Move(squareIndex, targetIndex, BLACK_KNIGHTS_ID);
+		moves &= moves - 1;
+	}
+}
+
 class StateWhite;
 class StateBlack;
 using AlignedState = std::aligned_storage<sizeof(State), alignof(State)>::type;
@@ -358,15 +515,15 @@ public:
 	void update_captures_check(U64 coverage, U64 check_mask);
 
 	void update_pawn_structure_eval();
-	void update_moves_and_squares();
+	template<MoveGenPolicy P = FULL_GEN> void update_moves_and_squares();
 	void update_captures_and_squares();
-	std::tuple<U64, U64, U64> update_covered_squares();
+	template<MoveGenPolicy P = FULL_GEN> std::tuple<U64, U64, U64> update_covered_squares();
 
 	StateBlack* move_board_update(Move& mv, AlignedState* aligned_state);
-	StateBlack* internal_move_aligned(Move& mv, AlignedState* aligned_state);
+	template<MoveGenPolicy P = FULL_GEN> StateBlack* internal_move_aligned(Move& mv, AlignedState* aligned_state);
 	StateBlack* null_move_aligned(AlignedState* aligned_state);
-	void internal_move_inplace(Move& mv);
-	void perft_all_moves(U8 depth, U64& total_moves);
+	template<MoveGenPolicy P = FULL_GEN> void internal_move_inplace(Move& mv);
+	template<MoveGenPolicy P = HASH_GEN> void perft_all_moves(U8 depth, U64& total_moves);
 };
 
 class StateBlack : public State {
@@ -384,15 +541,15 @@ public:
 	void update_captures_check(U64 coverage, U64 check_mask);
 
 	void update_pawn_structure_eval();
-	void update_moves_and_squares();
+	template<MoveGenPolicy P = FULL_GEN> void update_moves_and_squares();
 	void update_captures_and_squares();
-	std::tuple<U64, U64, U64> update_covered_squares();
+	template<MoveGenPolicy P = FULL_GEN> std::tuple<U64, U64, U64> update_covered_squares();
 
 	StateWhite* move_board_update(Move& mv, AlignedState* aligned_state);
-	StateWhite* internal_move_aligned(Move& mv, AlignedState* aligned_state);
+	template<MoveGenPolicy P = FULL_GEN> StateWhite* internal_move_aligned(Move& mv, AlignedState* aligned_state);
 	StateWhite* null_move_aligned(AlignedState* aligned_state);
-	void internal_move_inplace(Move& mv);
-	void perft_all_moves(U8 depth, U64& total_moves);
+	template<MoveGenPolicy P = FULL_GEN> void internal_move_inplace(Move& mv);
+	template<MoveGenPolicy P = HASH_GEN> void perft_all_moves(U8 depth, U64& total_moves);
 };
 
 typedef std::variant<StateWhite*, StateBlack*> StateMix;
@@ -445,12 +602,12 @@ struct PartialMoveVisitor {
 
 	StateMix operator()(StateWhite* st) {
 		StateBlack* stb = st->move_board_update(mv, aligned_st);
-		score = stb->get_eval();
+		score = stb->get_board_eval();
 		return StateMix(stb);
 	}
 	StateMix operator()(StateBlack* st) {
 		StateWhite* stw = st->move_board_update(mv, aligned_st);
-		score = stw->get_eval();
+		score = stw->get_board_eval();
 		return StateMix(stw);
 	}
 };
@@ -461,12 +618,13 @@ struct PromoCheck {
 	U8 operator()(auto& st) { return st->pawn_implicit_promo_check(mv); }
 };
 
+template<MoveGenPolicy P = HASH_GEN>
 struct PerftVisitor {
 	U8 depth;
 	PerftVisitor(U8 depth) : depth(depth) {}
 	U64 operator()(auto& st) { 
 		U64 total_moves = 0ULL;
-		st->perft_all_moves(depth, total_moves); 
+		st->template perft_all_moves<P>(depth, total_moves); 
 		return total_moves;
 	}
 };
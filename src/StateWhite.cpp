@@ -1,33 +1,35 @@
 #include "State.h"
 
+template<MoveGenPolicy P>
 constexpr U64(State::* board_move_functions[18])(U64, U64, U8, U8) = {
 	&State::moveNull,
 	&State::moveNull,
 	&State::moveWhitePawnsDouble,
 	&State::moveBlackPawnsDouble,
-	&State::moveWhitePawnsEnpassent,
-	&State::moveBlackPawnsEnpassent,
+	&State::moveWhitePawnsEnpassent<P>,
+	&State::moveBlackPawnsEnpassent<P>,
 	&State::moveNull,
 	&State::moveNull,
-	&State::moveWhitePawnsPromo,
-	&State::moveBlackPawnsPromo,
+	&State::moveWhitePawnsPromo<P>,
+	&State::moveBlackPawnsPromo<P>,
 	&State::moveNull,
 	&State::moveNull,
 	&State::moveNull,
 	&State::moveNull,
 	&State::moveNull,
 	&State::moveNull,
-	&State::moveWhiteKingCastle,
-	&State::moveBlackKingCastle,
+	&State::moveWhiteKingCastle<P>,
+	&State::moveBlackKingCastle<P>,
 };
 
 StateWhite::StateWhite(StateBlack& s) : State(static_cast<State&>(s)) {}
 
+template<MoveGenPolicy P>
 StateBlack* StateWhite::internal_move_aligned(Move& mv, AlignedState* aligned_state) {
 	StateBlack* new_state = new (aligned_state) StateBlack(*this);
 
-	new_state->internal_move_inplace(mv);
-	new_state->update_moves_and_squares();
+	new_state->template internal_move_inplace<P>(mv);
+	new_state->template update_moves_and_squares<P>();
 
 	return new_state;
 }
@@ -37,8 +39,7 @@ StateBlack* StateWhite::null_move_aligned(AlignedState* aligned_state) {
 	new_state->zobrist_hash ^= this->data_table->get_zhash_turn() ^ this->data_table->get_zobrist_hash_index(832 + this->events.get_data()) ^ this->data_table->get_zobrist_hash_index(bsf(enpassent_square >> 40));
 	new_state->null_move = true;
 	new_state->enpassent_square = 0ULL;
-	new_state->mg_eval.base_eval *= -1;
-	new_state->eg_eval.base_eval *= -1;
+	new_state->packed_eval.base_eval *= -1;
 	new_state->update_moves_and_squares();
 	return new_state;
 }
@@ -51,7 +52,7 @@ StateBlack* StateWhite::move_board_update(Move& mv, AlignedState* aligned_state)
 
 void StateWhite::update_moves_start(U64 coverage, U64 check_mask, U64 checkers) {
 	if (checkers == 0) { this->update_moves(coverage); }
-	else if (__popcnt64(checkers) == 1) { in_check = true; this->update_moves_check(coverage, check_mask); }
+	else if (popcnt(checkers) == 1) { in_check = true; this->update_moves_check(coverage, check_mask); }
 	else {
 		in_check = true;
 		U64 king = this->piecesBB[WHITE_KING_ID];
@@ -101,7 +102,7 @@ void StateWhite::update_moves_check(U64 coverage, U64 check_mask) {
 
 void StateWhite::update_captures_start(U64 coverage, U64 check_mask, U64 checkers) {
 	if (checkers == 0) { this->update_captures(coverage); }
-	else if (__popcnt64(checkers) == 1) { in_check = true; this->update_captures_check(coverage, check_mask); }
+	else if (popcnt(checkers) == 1) { in_check = true; this->update_captures_check(coverage, check_mask); }
 	else {
 		in_check = true;
 
@@ -157,48 +158,39 @@ void StateWhite::update_captures_check(U64 coverage, U64 check_mask) {
 	this->move_iter = mv;
 }
 
+template<MoveGenPolicy P>
 void StateWhite::update_moves_and_squares() {
-	U64 og_zhash = zobrist_hash;
-	auto [coverage, checkers, check_mask] = update_covered_squares();
+	auto [coverage, checkers, check_mask] = update_covered_squares<P>();
 
 	update_moves_start(coverage, check_mask, checkers);
-	zobrist_hash = og_zhash ^ this->data_table->get_zobrist_hash_index(832 + events.get_data()) ^ this->data_table->get_zobrist_hash_index(bsf(enpassent_square >> 40));
+	if constexpr (GEN_HASH) zobrist_hash ^= this->data_table->get_zobrist_hash_index(832 + events.get_data()) ^ this->data_table->get_zobrist_hash_index(bsf(enpassent_square >> 40));
 }
 
 void StateWhite::update_captures_and_squares() {
-	U64 og_zhash = zobrist_hash;
-	auto [coverage, checkers, check_mask] = update_covered_squares();
+	auto [coverage, checkers, check_mask] = update_covered_squares<FULL_GEN>();
 
 	update_captures_start(coverage, check_mask, checkers);
-	zobrist_hash = og_zhash ^ this->data_table->get_zobrist_hash_index(832 + events.get_data()) ^ this->data_table->get_zobrist_hash_index(bsf(enpassent_square >> 40));
+	zobrist_hash ^= this->data_table->get_zobrist_hash_index(832 + events.get_data()) ^ this->data_table->get_zobrist_hash_index(bsf(enpassent_square >> 40));
 }
 
 void StateWhite::update_pawn_structure_eval() {
-	PTableEntry& pEntry = this->data_table->get_ptable_entry(this->pawn_zhash);
-	if (pEntry.softEquals(this->pawn_zhash)) {
-		I16 pawn_score = pEntry.score;
-		this->mg_eval.base_eval += pawn_score;
-		this->eg_eval.base_eval += pawn_score;
-	}
-	else {
-		I16 pawn_score = get_pawn_structure_eval();
-		pEntry.setHash(this->pawn_zhash);
-		pEntry.score = pawn_score;
-		this->mg_eval.base_eval += pawn_score;
-		this->eg_eval.base_eval += pawn_score;
-	}
+	I16 pawn_score = get_pawn_entry().score;
+	this->packed_eval.base_eval += make_score(pawn_score, pawn_score);
 }
 
+template<MoveGenPolicy P>
 void StateWhite::internal_move_inplace(Move& mv) {
 	U8 fromIndex = mv.from();
 	U8 toIndex = mv.to();
 
 	U8 fromPieceID = this->squareOcc[fromIndex];
 	U8 toPieceID = this->squareOcc[toIndex];
-	
-	this->mg_eval.base_eval *= -1;
-	this->eg_eval.base_eval *= -1;
-	this->update_move_eval(fromIndex, toIndex, fromPieceID, toPieceID, this->events.wscore());
+	U64 old_occupancy = this->piecesBB[ALL_PIECES_ID];
+
+	if constexpr (GEN_EVAL) {
+		this->packed_eval.base_eval *= -1;
+		this->update_move_eval(fromIndex, toIndex, fromPieceID, toPieceID, this->events.wscore());
+	}
 
 	this->squareOcc[fromIndex] = EMPTY_ID;
 	this->squareOcc[toIndex] = fromPieceID;
@@ -210,12 +202,14 @@ void StateWhite::internal_move_inplace(Move& mv) {
 	this->piecesBB[toPieceID] ^= toPieceBB;
 
 	U64 enp_square = this->enpassent_square;
-	zobrist_hash ^= this->data_table->get_zobrist_hash_index(832 + this->events.get_data())
-		^ this->data_table->get_zobrist_hash(fromIndex, fromPieceID)
-		^ this->data_table->get_zobrist_hash(toIndex, fromPieceID)
-		^ this->data_table->get_zobrist_hash(toIndex, toPieceID)
-		^ this->data_table->get_zobrist_hash_index(bsf(enp_square >> 16))
-		^ this->data_table->get_zhash_turn();
+	if constexpr (GEN_HASH) {
+		zobrist_hash ^= this->data_table->get_zobrist_hash_index(832 + this->events.get_data())
+			^ this->data_table->get_zobrist_hash(fromIndex, fromPieceID)
+			^ this->data_table->get_zobrist_hash(toIndex, fromPieceID)
+			^ this->data_table->get_zobrist_hash(toIndex, toPieceID)
+			^ this->data_table->get_zobrist_hash_index(bsf(enp_square >> 16))
+			^ this->data_table->get_zhash_turn();
+	}
 
 	U8 move_index = 1, promoID = 0;
 	if (fromPieceID == BLACK_PAWNS_ID) {
@@ -224,19 +218,22 @@ void StateWhite::internal_move_inplace(Move& mv) {
 		U8 pawn_promotion = (promoID != 0) << 3;
 		move_index |= pawn_enpassent | pawn_promotion;
 		this->enpassent_square = (fromPieceBB >> 8) & (toPieceBB << 8);
-		this->pawn_zhash ^= this->data_table->get_zhash_bpawn_table(fromIndex) ^ this->data_table->get_zhash_bpawn_table(toIndex);;
+		if constexpr (GEN_HASH) this->pawn_zhash ^= this->data_table->get_zhash_bpawn_table(fromIndex) ^ this->data_table->get_zhash_bpawn_table(toIndex);
 	}
 	else {
 		move_index |= ((abs((int)(fromIndex - toIndex)) == 2) & (fromPieceID == BLACK_KING_ID)) << 4;
 		this->enpassent_square = 0ULL;
 	}
 
-	if (toPieceID == WHITE_PAWNS_ID) this->pawn_zhash ^= this->data_table->get_zhash_wpawn_table(toIndex);
+	if (GEN_HASH && toPieceID == WHITE_PAWNS_ID) this->pawn_zhash ^= this->data_table->get_zhash_wpawn_table(toIndex);
 
 	if (move_index == 1) this->moveBlackPiece(fromPieceBB, toPieceBB);
-	else (this->*board_move_functions[move_index])(fromPieceBB, toPieceBB, promoID, toIndex);
+	else (this->*board_move_functions<P>[move_index])(fromPieceBB, toPieceBB, promoID, toIndex);
+	if (GEN_EVAL && this->data_table->use_nnue) this->update_move_nnue(fromIndex, toIndex, fromPieceID, toPieceID, move_index);
+	if constexpr (INCREMENTAL_SLIDER_ATTACKS) this->update_slider_attacks(old_occupancy ^ this->piecesBB[ALL_PIECES_ID], toPieceBB);
 }
 
+template<MoveGenPolicy P>
 std::tuple<U64, U64, U64> StateWhite::update_covered_squares() {
 	U64 pawns_BB = this->piecesBB[BLACK_PAWNS_ID];
 	U64 enemy_king = this->piecesBB[WHITE_KING_ID];
@@ -245,7 +242,7 @@ std::tuple<U64, U64, U64> StateWhite::update_covered_squares() {
 	U64 r_attacks = ((pawns_BB >> 7) & NOT_FILE_A);
 	U64 checkers = ((l_attacks & enemy_king) << 9) | ((r_attacks & enemy_king) << 7);
 	U64 coverage = l_attacks | r_attacks;
-	zobrist_hash = ~coverage;
+	if constexpr (GEN_EVAL) mobility_area = ~coverage;
 
 	coverage |= this->get_moves_king(bsf(this->piecesBB[BLACK_KING_ID]), 0ULL);
 
@@ -255,42 +252,60 @@ std::tuple<U64, U64, U64> StateWhite::update_covered_squares() {
 	add_to_coverage(knights, 0ULL, coverage, &State::get_moves_knight);
 
 	QueenLine enemy_king_lines = this->data_table->queen_lines[enemy_king_index];
-	U64 all_pieces = this->piecesBB[ALL_PIECES_ID];
 
 	U64 queens = this->piecesBB[BLACK_QUEENS_ID];
 	U64 queen_pinning = enemy_king_lines.queen & queens;
 	queens ^= queen_pinning;
-	add_to_coverage(queens, all_pieces, coverage, &State::get_moves_queen);
 
 	U64 bishops = this->piecesBB[BLACK_BISHOPS_ID];
 	U64 bishops_pinning = enemy_king_lines.bishop & (bishops | queen_pinning);
 	bishops &= ~bishops_pinning;
-	add_to_coverage(bishops, all_pieces, coverage, &State::get_moves_bishop);
 
 	U64 rooks = this->piecesBB[BLACK_ROOKS_ID];
 	U64 rooks_pinning = enemy_king_lines.rook & (rooks | queen_pinning);
 	rooks &= ~rooks_pinning;
-	add_to_coverage(rooks, all_pieces, coverage, &State::get_moves_rook);
+
+	add_slider_coverage(queens, bishops, rooks, coverage);
 
 	U64 check_mask = checkers;
 	if (rooks_pinning | bishops_pinning | queen_pinning) check_mask |= handle_pinning_and_checks(rooks_pinning, bishops_pinning, queen_pinning, enemy_king_index, coverage, checkers);
 	check_mask += (check_mask == 0) * FULL_BOARD;
+	if constexpr (GEN_EVAL) enemy_attacks = coverage;
 
 	this->enpassent_square &= (check_mask << 8);
 	return std::tuple(coverage, checkers, check_mask);
 }
 
+template<MoveGenPolicy P>
 void StateWhite::perft_all_moves(U8 depth, U64& total_moves) {
 	if (depth == 1) { total_moves += (this->move_iter - this->move_arr); return; }
 
-	HTableEntryPerft& zentry = this->data_table->get_perft_entry(this->zobrist_hash);
-	if (zentry.softEquals(zobrist_hash) && zentry.depth == depth) { total_moves += zentry.perft_moves; return; }
+	AlignedState aligned_st;
+	if constexpr (!GEN_HASH) {
+		for (Move* mv = this->move_arr; mv != this->move_iter; mv++) this->internal_move_aligned<P>(*mv, &aligned_st)->template perft_all_moves<P>(depth - 1, total_moves);
+		return;
+	}
+
+	U64 stored_moves;
+	HTableBucketPerft& zbucket = this->data_table->get_perft_bucket(this->zobrist_hash);
+	if (zbucket.probe(zobrist_hash, depth, stored_moves)) { total_moves += stored_moves; return; }
 
 	U64 start_moves = total_moves;
-	AlignedState aligned_st;
-	for (Move* mv = this->move_arr; mv != this->move_iter; mv++) this->internal_move_aligned(*mv, &aligned_st)->perft_all_moves(depth - 1, total_moves);
+	for (Move* mv = this->move_arr; mv != this->move_iter; mv++) this->internal_move_aligned<P>(*mv, &aligned_st)->template perft_all_moves<P>(depth - 1, total_moves);
 
-	zentry.setHash(zobrist_hash);
-	zentry.depth = depth;
-	zentry.perft_moves = (U32)(total_moves - start_moves);
+	zbucket.store(zobrist_hash, depth, total_moves - start_moves);
 }
+
+/*
+	Explicit instantiations for every move generator policy
+*/
+
+#define INSTANTIATE_STATE_WHITE(P) \
+	template StateBlack* StateWhite::internal_move_aligned<P>(Move&, AlignedState*); \
+	template void StateWhite::internal_move_inplace<P>(Move&); \
+	template void StateWhite::update_moves_and_squares<P>(); \
+	template void StateWhite::perft_all_moves<P>(U8, U64&);
+
+INSTANTIATE_STATE_WHITE(FULL_GEN)
+INSTANTIATE_STATE_WHITE(HASH_GEN)
+INSTANTIATE_STATE_WHITE(PURE_GEN)
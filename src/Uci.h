@@ -8,9 +8,13 @@
 #include <vector>
 #include <cmath>
 #include <map>
+#include <atomic>
+#include <thread>
+#include <mutex>
 
 #include "State.h"
 #include "Search.h"
+#include "SearchThread.h"
 #include "DataTable.h"
 
 typedef std::variant<Search<Regular>, Search<Debug>> SearchVar;
@@ -27,32 +31,67 @@ struct RepetitionSetter {
 struct MaxSearchTimeSetter {
 	U64 max_time;
 	MaxSearchTimeSetter(U64 max_time) : max_time(max_time) {}
-	void operator()(auto& search) { search.time_pkg.max_thinking_time = max_time; }
+	void operator()(auto& search) { search.time_pkg.max_thinking_time = max_time * 1000; }
 };
 
-struct DepthSearchVisitor {
+struct StopSetter {
+	bool stop;
+	StopSetter(bool stop) : stop(stop) {}
+	void operator()(auto& search) { search.time_pkg.stop_searching = stop; }
+};
+
+struct LimitsSetter {
+	SearchLimits limits;
+	LimitsSetter(SearchLimits limits) : limits(limits) {}
+	void operator()(auto& search) { search.set_limits(limits); }
+};
+
+struct InfoOutputSetter {
+	std::function<void(std::string)> info_output;
+	InfoOutputSetter(std::function<void(std::string)> info_output) : info_output(info_output) {}
+	void operator()(auto& search) { search.info_output = info_output; }
+};
+
+struct PonderSetter {
+	bool pondering;
+	PonderSetter(bool pondering) : pondering(pondering) {}
+	void operator()(auto& search) { search.time_pkg.pondering = pondering; }
+};
+
+struct PonderMoveVisitor {
 	StateMix stx;
-	U8 depth;
-	DepthSearchVisitor(StateMix& passed_stx, U8 d) : stx(passed_stx), depth(d) {}
-	Move operator()(auto& st) { return st.depth_search(stx, depth); }
+	Move best_move;
+	PonderMoveVisitor(StateMix& passed_stx, Move best_move) : stx(passed_stx), best_move(best_move) {}
+	Move operator()(auto& search) { return search.get_ponder_move(stx, best_move); }
 };
 
 struct InfiniteSearchVisitor {
 	StateMix stx;
 	InfiniteSearchVisitor(StateMix& passed_stx) : stx(passed_stx) {}
-	Move operator()(auto& search) { return search.timed_search(stx, search.time_pkg.max_thinking_time); }
+	Move operator()(auto& search) { return search.infinite_search(stx); }
+};
+
+struct MaxTimeSearchVisitor {
+	StateMix stx;
+	MaxTimeSearchVisitor(StateMix& passed_stx) : stx(passed_stx) {}
+	Move operator()(auto& search) {
+		search.time_pkg.set_fixed_time(search.time_pkg.max_thinking_time);
+		return search.timed_search(stx);
+	}
 };
 
 struct TimedSearchVisitor {
 	StateMix stx;
-	U64 time_left;
-	TimedSearchVisitor(StateMix& passed_stx, U64 time_left) : stx(passed_stx), time_left(time_left) {}
+	TimeControl tc;
+	TimedSearchVisitor(StateMix& passed_stx, TimeControl tc) : stx(passed_stx), tc(tc) {}
 	Move operator()(auto& search) { 
-		search.time_pkg.reset(time_left);
-		return search.timed_search(stx, search.time_pkg.get_allocated_time());
+		search.time_pkg.set_time_control(tc);
+		return search.timed_search(stx);
 	}
 };
 
+struct EvalCacheClearer { void operator()(auto& search) { search.eval_cache.clear(); } };
+
 struct NewCerr {
 	std::stringstream new_buf;
 	std::streambuf* old_buf;
@@ -65,6 +104,11 @@ class UCI {
 public:
 	std::string log_filename;
 	bool debug;
+	std::atomic<bool> perft_running = false;
+	bool use_nnue = false;
+	bool ponder = false;
+	bool send_info = false;
+	U8 multi_pv = 1;
 
 	SearchVar search = Search<Regular>();
 	DataTable& dtable = DataTable::getInstance();
@@ -73,6 +117,9 @@ public:
 	StateBlack stb = StateBlack(&dtable);
 	StateMix stx = StateMix(&stw);
 
+	SearchThread search_thread;
+	std::mutex output_mutex;
+
 	UCI() : debug(false) {
 		this->log_filename = this->get_log_filename();
 		start_error_logging();
@@ -114,23 +161,30 @@ public:
 
 		std::stringstream ss;
 		struct tm timeinfo;
+#ifdef _WIN32
 		localtime_s(&timeinfo, &time);
+#else
+		localtime_r(&time, &timeinfo);
+#endif
 		ss << std::put_time(&timeinfo, "%H:%M:%S.") << std::setfill('0') << std::setw(3) << millisecondsComponent;
 		return ss.str();
 	}
 
 	void log_msg(std::string msg) {
 		if (msg == "") return;
+		std::lock_guard<std::mutex> lock(output_mutex);
 		std::ofstream engine_log;
 		engine_log.open(log_filename, std::ios::app);
 		engine_log << get_timestamp() << " | " << msg << "\n";
 		engine_log.close();
 	}
 
+	// Both the UCI and the search thread respond, the output lock keeps the lines whole
 	void uci_resp(std::string resp) {
 		if (resp == "") return;
 		log_msg(resp);
-		std::cout << resp << "\n";
+		std::lock_guard<std::mutex> lock(output_mutex);
+		std::cout << resp << std::endl;
 	}
 
 	void set_debug(bool turn_on_debug) {
@@ -156,6 +210,10 @@ public:
 		else if (cmd == "position") process_position(split_msg);
 		else if (cmd == "ucinewgame") { stw.construct_startpos(stw.data_table); stx = StateMix(&stw); }
 		else if (cmd == "sts") process_STS(split_msg);
+		else if (cmd == "perftsuite") process_perftsuite(split_msg);
+		else if (cmd == "sliderbench") process_slider_bench(split_msg);
+		else if (cmd == "bench") process_bench(split_msg);
+		else if (cmd == "matesuite") process_mate_suite(split_msg);
 		else if (cmd == "print") std::visit(PrintBoard(), stx);
 		else if (cmd == "quit") exit(0);
 		else return "Unknown command: '" + cmd + "'.\n";
@@ -163,15 +221,56 @@ public:
 		return "";
 	}
 
+	// Only searches started from the UCI loop report their iterations, commands run from the arguments just print the result
 	void start_loop() {
+		this->send_info = true;
 		while (1) {
 			std::string msg;
-			std::getline(std::cin, msg);
-			if (msg != "") {
-				try { uci_resp(parse_message(msg)); }
-				catch (...) { uci_resp("Failed to run command: '" + msg + "'"); }
-			}
+			if (!std::getline(std::cin, msg)) msg = "quit";
+			if (msg != "") dispatch_message(msg);
+		}
+	}
+
+	void run_message(std::string msg) {
+		try { uci_resp(parse_message(msg)); }
+		catch (...) { uci_resp("Failed to run command: '" + msg + "'"); }
+	}
+
+	/*
+		Searches and perft run on the search thread so stdin is still read while they run.
+		Only stop, ponderhit, isready and quit are handled meanwhile, any other command stops the search first.
+		Perft can not be stopped, those commands wait for it since it uses the position and the hash tables.
+	*/
+	void dispatch_message(std::string msg) {
+		auto split_msg = splitString(msg, ' ');
+		std::string cmd = split_msg[0];
+		str_lower(cmd);
+
+		if (cmd == "stop") { log_msg(msg); if (!perft_running) stop_search(); return; }
+		if (cmd == "isready") { log_msg(msg); uci_resp("readyok"); return; }
+		if (cmd == "ponderhit") { log_msg(msg); std::visit(PonderSetter{ false }, search); return; }
+		if (cmd == "quit") {
+			log_msg(msg);
+			if (!perft_running) stop_search();
+			exit(0);
+		}
+
+		if (search_thread.is_searching()) stop_search();
+		bool perft = (cmd == "go" && split_msg.size() > 1 && split_msg[1] == "perft") || cmd == "perftsuite";
+		if (cmd == "go" && !perft) {
+			std::visit(StopSetter{ false }, search);
+			std::visit(PonderSetter{ std::find(split_msg.begin(), split_msg.end(), "ponder") != split_msg.end() }, search);
 		}
+		if (cmd == "go" || perft) {
+			search_thread.start([this, msg] { run_message(msg); });
+			return;
+		}
+		run_message(msg);
+	}
+
+	void stop_search() {
+		std::visit(StopSetter{ true }, search);
+		search_thread.wait();
 	}
 
 	std::string uci_init() {
@@ -180,7 +279,13 @@ public:
 			"id author S\n"
 			"\n"
 			"option name Hash type spin default 256 min 1 max 16384\n"
-			//"option name Ponder type check default false\n"
+			"option name PawnHash type spin default 8 min 1 max 1024\n"
+			"option name PerftHash type spin default 64 min 1 max 16384\n"
+			"option name SliderBackend type combo default Auto var Auto var PEXT var Magic var Classical\n"
+			"option name UseNNUE type check default false\n"
+			"option name EvalFile type string default <empty>\n"
+			"option name Ponder type check default false\n"
+			"option name MultiPV type spin default 1 min 1 max 64\n"
 			"option name MaxSearchTime type spin default 5 min 1 max 120\n"
 			"uciok\n";
 	}
@@ -191,11 +296,60 @@ public:
 			std::string value = split_msg[4];
 			str_lower(option);
 			if (option == "hash") this->dtable.set_hash_table_size((U64)std::stoi(value));
+			else if (option == "pawnhash") this->dtable.set_pawn_table_size((U64)std::stoi(value));
+			else if (option == "perfthash") this->dtable.set_perft_table_size((U64)std::stoi(value));
+			else if (option == "sliderbackend") set_slider_backend(value);
+			else if (option == "usennue") set_use_nnue(value == "true");
+			else if (option == "ponder") this->ponder = (value == "true");
+			else if (option == "multipv") this->multi_pv = (U8)std::clamp(std::stoi(value), 1, (int)MAX_MULTI_PV);
+			else if (option == "evalfile") load_eval_file(join_option_value(split_msg));
 			else if (option == "maxsearchtime") std::visit(MaxSearchTimeSetter{ (U64)std::stoi(value) }, search);
 			else uci_resp("Unknown option: '" + option + "'");
 		} catch (...) { uci_resp("Failed to process setoption"); }
 	}
 
+	void set_slider_backend(std::string value) {
+		str_lower(value);
+		SliderBackend backend = detect_slider_backend();
+		if (value == "pext" && cpu_has_bmi2()) backend = SliderBackend::Pext;
+		else if (value == "magic") backend = SliderBackend::Magic;
+		else if (value == "classical") backend = SliderBackend::Classical;
+		this->dtable.slider_backend = backend;
+		uci_resp("info string Slider backend: " + slider_backend_name(backend));
+	}
+
+	// File names can contain spaces, so everything after "value" is the value
+	std::string join_option_value(std::vector<std::string>& split_msg) {
+		std::string value = split_msg[4];
+		for (U64 i = 5; i < split_msg.size(); i++) value += " " + split_msg[i];
+		return value;
+	}
+
+	void load_eval_file(std::string filename) {
+		auto network = load_nnue_network(filename);
+		if (!network) {
+			uci_resp("info string Failed to load NNUE network from '" + filename + "'");
+			return;
+		}
+		this->dtable.nnue = std::move(network);
+		uci_resp("info string Loaded NNUE network from '" + filename + "'");
+		set_use_nnue(this->use_nnue);
+	}
+
+	// The network is only used once one is loaded, both options can be sent in any order
+	void set_use_nnue(bool enabled) {
+		this->use_nnue = enabled;
+		this->dtable.use_nnue = enabled && this->dtable.nnue;
+		if (enabled && !this->dtable.nnue) uci_resp("info string No NNUE network loaded, set EvalFile to use it");
+
+		// The accumulators of the current position are only kept while the network is in use
+		std::visit(StateCast(), stx)->full_eval();
+
+		// Evaluations cached in the eval cache and the search table may come from the other evaluator
+		std::visit(EvalCacheClearer(), search);
+		this->dtable.reset_TPT();
+	}
+
 	void process_debug(std::vector<std::string> split_msg) {
 		if (split_msg.size() == 1) std::cout << "Missing parameter: [ on | off ]\n";
 		set_debug(split_msg[1] == "on");
@@ -228,6 +382,12 @@ public:
 	}
 
 	void process_STS(std::vector<std::string> split_msg);
+	U8 parse_perft_depth(std::vector<std::string>& split_msg, U64 index, U8 max_depth);
+	void process_perft(std::vector<std::string> all_cmds);
+	void process_perftsuite(std::vector<std::string> split_msg);
+	void process_slider_bench(std::vector<std::string> split_msg);
+	void process_bench(std::vector<std::string> split_msg);
+	void process_mate_suite(std::vector<std::string> split_msg);
 
 	void process_position(std::vector<std::string> split_msg) {
 		int i = 3;
@@ -258,46 +418,74 @@ public:
 		process_moves(move_vector, whiteTurn);
 	}
 
+	// The reply expected from the opponent is only sent with pondering enabled
+	std::string bestmove_resp(Move mv) {
+		std::string resp = "bestmove " + mv.toUciString();
+		if (!this->ponder) return resp;
+
+		Move ponder_mv = std::visit(PonderMoveVisitor{ stx, mv }, search);
+		if (ponder_mv.data != 0) resp += " ponder " + ponder_mv.toUciString();
+		return resp;
+	}
+
+	// A ponder search is a regular search of the position after the expected reply, pondering is set up by dispatch_message
 	std::string process_go(std::vector<std::string> all_cmds) {
-		std::string go_cmd = all_cmds[1];
-		if (go_cmd == "depth") {
-			U8 depth = (U8)std::stoi(all_cmds[2]);
-			Move mv = std::visit(DepthSearchVisitor{ stx, depth }, search);
-			return "bestmove " + mv.toString();
-		}
-		else if (go_cmd == "infinite") {
-			Move mv = std::visit(InfiniteSearchVisitor{ stx }, search);
-			return "bestmove " + mv.toString();
+		std::erase(all_cmds, "ponder");
+		if (perft_running) return "Perft still running, ignoring 'go'";
+		if (all_cmds.size() > 1 && all_cmds[1] == "perft") {
+			process_perft(all_cmds);
+			return "";
 		}
-		else if (go_cmd == "wtime" || go_cmd == "btime") {
-			Move mv = std::visit(TimedSearchVisitor{ stx, this->parse_time_left(all_cmds) }, search);
-			return "bestmove " + mv.toString();
-		}
-		else if (go_cmd == "movetime") {
-			Move mv = std::visit(TimedSearchVisitor{ stx, (U64)std::stoi(all_cmds[2])*20 }, search);
-			return "bestmove " + mv.toString();
-		}
-		else if (go_cmd == "perft") {
-			this->dtable.usePerftTable();
-			U8 depth = (U8)std::stoi(all_cmds[2]);
-			U64 total_moves = std::visit(PerftVisitor{ depth }, stx);
-			this->dtable.useSearchTable();
-			return "Nodes searched: " + std::to_string(total_moves);
+
+		auto has_token = [&](std::string token) { return std::find(all_cmds.begin(), all_cmds.end(), token) != all_cmds.end(); };
+		SearchLimits limits = parse_search_limits(all_cmds);
+		limits.multi_pv = this->multi_pv;
+		bool infinite = has_token("infinite");
+		bool timed = has_token("wtime") || has_token("btime") || has_token("movetime");
+		bool limited = (limits.depth != MAX_SEARCH_DEPTH) || limits.nodes || limits.mate;
+		std::visit(LimitsSetter{ limits }, search);
+		if (this->send_info) std::visit(InfoOutputSetter{ [this](std::string line) { uci_resp(line); } }, search);
+
+		Move mv;
+		if (timed && !infinite) mv = std::visit(TimedSearchVisitor{ stx, this->parse_time_control(all_cmds) }, search);
+		else if (infinite || limited) mv = std::visit(InfiniteSearchVisitor{ stx }, search);
+		else mv = std::visit(MaxTimeSearchVisitor{ stx }, search);
+		return bestmove_resp(mv);
+	}
+
+	// Limits can be combined with each other and with the clock, searchmoves takes every move up to the next keyword
+	SearchLimits parse_search_limits(std::vector<std::string> all_cmds) {
+		static const std::set<std::string> go_keywords = { "searchmoves", "wtime", "btime", "winc", "binc", "movestogo", "depth", "nodes", "mate", "movetime", "infinite" };
+		SearchLimits limits;
+		State& st = *std::visit(StateCast(), stx);
+		for (U64 i = 1; i < all_cmds.size(); i++) {
+			if (all_cmds[i] == "depth" && i + 1 < all_cmds.size()) limits.depth = (U8)std::clamp(std::stoi(all_cmds[++i]), 1, (int)MAX_SEARCH_DEPTH);
+			else if (all_cmds[i] == "nodes" && i + 1 < all_cmds.size()) limits.nodes = std::max(std::stoull(all_cmds[++i]), 1ULL);
+			else if (all_cmds[i] == "mate" && i + 1 < all_cmds.size()) limits.mate = (U8)std::clamp(std::stoi(all_cmds[++i]), 1, (int)MAX_SEARCH_DEPTH / 2);
+			else if (all_cmds[i] == "searchmoves") {
+				while (i + 1 < all_cmds.size() && !go_keywords.contains(all_cmds[i + 1])) {
+					Move mv = Move(all_cmds[++i], st.turn);
+					if (!mv.promotion()) mv.data |= st.pawn_implicit_promo_check(mv) << 12;
+					limits.search_moves.push_back(mv);
+				}
+			}
 		}
-		return "bestmove a1a1";
+		return limits;
 	}
 
-	U64 parse_time_left(std::vector<std::string> all_cmds) {
-		U64 time_left = 0;
-		U64 time_inc = 0;
+	TimeControl parse_time_control(std::vector<std::string> all_cmds) {
+		TimeControl tc;
 		U8 our_color = std::visit(TurnCheck{}, stx);
-		char color_char = (our_color == 0) ? 'w' : 'b';
-		for (U8 i = 1; i < all_cmds.size(); i++) {
-			if (all_cmds[i][0] != color_char) continue;
-			else if (all_cmds[i] == std::string(1, color_char) + "time") time_left = std::stoi(all_cmds[i + 1]);
-			else if (all_cmds[i] == std::string(1, color_char) + "inc") time_inc = std::stoi(all_cmds[i + 1]);
+		std::string color_str = (our_color == 0) ? "w" : "b";
+		// Clocks can be sent negative once the time is up
+		auto value = [&](U64 i) { return (U64)std::max(std::stoll(all_cmds[i + 1]), 0LL); };
+		for (U64 i = 1; i + 1 < all_cmds.size(); i++) {
+			if (all_cmds[i] == color_str + "time") tc.time_left = value(i);
+			else if (all_cmds[i] == color_str + "inc") tc.increment = value(i);
+			else if (all_cmds[i] == "movestogo") tc.moves_to_go = value(i);
+			else if (all_cmds[i] == "movetime") tc.move_time = value(i);
 		}
-		return time_left + time_inc;
+		return tc;
 	}
 
 };
\ No newline at end of file